@@ -11,10 +11,308 @@ bl_info = {
 }
 
 import bpy
+import math
+import numpy
+import queue
+import struct
+import threading
+import time
+import traceback
+import zlib
+from bpy.app.handlers import persistent
 from socket import *
 sub=[]
 sub_names=[]
 names=[]
+
+# Binary wire format, must match RgbPoseProtocol.h in the RgbPoseLiveLink plugin
+RGBP_MAGIC = 0x50424752
+RGBP_VERSION = 2
+RGBP_HEADER = struct.Struct("<IBBBBIIHIQ")
+RGBP_SKELETON = 1
+RGBP_POSE = 2
+RGBP_POSE_DELTA = 3
+RGBP_FRAGMENT = 4
+RGBP_FLAG_HALF = 1
+RGBP_FLAG_HIERARCHY = 2
+RGBP_FLAG_KEYFRAME = 4
+RGBP_FLAG_PACKED = 8
+# Poses are sent as Blender stores them, in metres and unflipped, and converted by the receiver in bulk
+RGBP_FLAG_BLENDER_SPACE = 16
+RGBP_DELTA_HEADER = struct.Struct("<IfH")
+RGBP_FRAGMENT_HEADER = struct.Struct("<IIIHH")
+# Delta packets store position offsets from the keyframe as int16 steps of this many metres
+DELTA_POSITION_QUANTUM = 0.0001
+# The three smaller components of a unit quaternion lie within +-1/sqrt(2)
+SMALLEST_THREE_RANGE = math.sqrt(0.5)
+# Packets of several subjects share a datagram up to this size, kept under a typical 1500 byte MTU so routers never
+# fragment them. Larger messages are split into fragment packets the receiver reassembles
+MAX_DATAGRAM_SIZE = 1400
+FRAGMENT_CHUNK_SIZE = MAX_DATAGRAM_SIZE - RGBP_HEADER.size - RGBP_FRAGMENT_HEADER.size
+# Counted up per fragmented message, only touched by the send thread
+message_id = 0
+# Skeleton packets are repeated so a receiver started late still learns the bone names and parents
+SKELETON_RESEND_FRAMES = 30
+frame_number = 0
+# Counts the send_frame calls, including the ones that send nothing
+pose_read_count = 0
+# Monotonic clock in microseconds when the current frame was sampled, lets the receiver measure latency
+send_time_us = 0
+announced_subjects = set()
+# Per subject sequence numbers, the receiver drops poses that arrive late or twice
+subject_sequences = {}
+# Last keyframe sent per subject as (sequence, positions, rotations), delta packets are encoded against it
+keyframes = {}
+# Bone names, parents and component buffers per armature, see bone_cache
+bone_caches = {}
+# Where the three smaller components of a smallest-three rotation come from, by index of the largest one
+SMALLEST_THREE_ORDER = numpy.array([[1, 2, 3], [0, 2, 3], [0, 1, 3], [0, 1, 2]])
+# The text protocol carries rotations with x and z flipped
+TEXT_ROTATION_SIGNS = numpy.array([-1.0, 1.0, -1.0, 1.0])
+# One bone of a P_ entry, the partial update of an armature
+BONE_TEXT_FORMAT = "%s:(%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f)|"
+
+def subject_id(name):
+    return zlib.crc32(name.encode("utf-8")) & 0xFFFFFFFF
+
+def next_sequence(name):
+    sequence = subject_sequences.get(name, 0)
+    subject_sequences[name] = (sequence + 1) & 0xFFFFFFFF
+    return sequence
+
+def skeleton_due(name):
+    due = name not in announced_subjects or frame_number % SKELETON_RESEND_FRAMES == 0
+    announced_subjects.add(name)
+    return due
+
+def bone_parents(bones):
+    index = {bone.name: i for i, bone in enumerate(bones)}
+    return [index[bone.parent.name] if bone.parent else -1 for bone in bones]
+
+class BoneCache:
+    # Everything about an armature that only changes with its bone list, plus buffers foreach_get fills every tick
+    def __init__(self, bones):
+        #mixamo bone name conversion
+        self.names = [bone.name.split(":")[-1] for bone in bones]
+        self.parents = bone_parents(bones)
+        self.positions = numpy.empty(len(bones) * 3, dtype=numpy.float32)
+        self.rotations = numpy.empty(len(bones) * 4, dtype=numpy.float32)
+        # One format string for the whole armature, a text entry is a single % operation
+        self.text_format = "".join(name.replace("%", "%%") + ":(%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f)|" for name in self.names)
+        # Components of every bone as the receiver last got them, None until the first full pose is sent
+        self.sent_positions = None
+        self.sent_rotations = None
+        # pose_read_count the buffers were last filled at, see read_pose
+        self.read_frame = -1
+
+def bone_cache(name, refresh=False):
+    # Rebuilt when the bone count changes, and on refresh, which callers pass when the skeleton is resent to catch renames
+    bones = bpy.data.objects[name].pose.bones
+    cache = bone_caches.get(name)
+    if cache is None or refresh or len(cache.names) != len(bones):
+        cache = bone_caches[name] = BoneCache(bones)
+    return cache
+
+def hierarchy_entry(snapshot):
+    return "H_" + snapshot.name + "=" + ",".join(str(parent) for parent in snapshot.parents) + "||"
+
+def pack_name(name):
+    data = name.encode("utf-8")[:255]
+    return struct.pack("<B", len(data)) + data
+
+def encode_packet(packet_type, flags, name, frame, bone_count, payload):
+    header = RGBP_HEADER.pack(RGBP_MAGIC, RGBP_VERSION, RGBP_HEADER.size, packet_type, flags,
+                              subject_id(name), frame & 0xFFFFFFFF, bone_count, len(payload), send_time_us)
+    return header + payload
+
+def encode_skeleton_packet(name, bone_names, parents):
+    payload = pack_name(name) + b"".join(pack_name(bone_name) for bone_name in bone_names)
+    payload += struct.pack("<%dh" % len(parents), *parents)
+    return encode_packet(RGBP_SKELETON, RGBP_FLAG_HIERARCHY, name, 0, len(bone_names), payload)
+
+def encode_pose_packet(name, frame, positions, rotations, half, keyframe=False):
+    component = "<f2" if half else "<f4"
+    payload = positions.astype(component).tobytes() + rotations.astype(component).tobytes()
+    flags = RGBP_FLAG_BLENDER_SPACE | (RGBP_FLAG_HALF if half else 0) | (RGBP_FLAG_KEYFRAME if keyframe else 0)
+    return encode_packet(RGBP_POSE, flags, name, frame, len(positions) // 3, payload)
+
+def pack_smallest_three(rotations):
+    # Index of the largest component in the top 2 bits, the other three in 10 bits each, the largest is made positive
+    quats = rotations.reshape(-1, 4).astype(numpy.float64)
+    lengths = numpy.linalg.norm(quats, axis=1, keepdims=True)
+    quats /= numpy.where(lengths > 0.0, lengths, 1.0)
+    largest = numpy.abs(quats).argmax(axis=1)
+    quats *= numpy.where(quats[numpy.arange(len(quats)), largest] < 0.0, -1.0, 1.0)[:, None]
+    steps = numpy.clip(numpy.rint((quats + SMALLEST_THREE_RANGE) / (2.0 * SMALLEST_THREE_RANGE) * 1023.0), 0, 1023).astype(numpy.uint32)
+    smaller = numpy.take_along_axis(steps, SMALLEST_THREE_ORDER[largest], axis=1)
+    return (largest.astype(numpy.uint32) << 30) | (smaller[:, 0] << 20) | (smaller[:, 1] << 10) | smaller[:, 2]
+
+def encode_packed_pose_packet(name, frame, positions, rotations):
+    # Positions in int16 steps of one scale for the whole skeleton, rotations in 32 bits each
+    scale = max(float(numpy.abs(positions).max(initial=0.0)), 1e-3) / 32767.0
+    payload = struct.pack("<f", scale)
+    payload += numpy.clip(numpy.rint(positions / scale), -32767, 32767).astype("<i2").tobytes()
+    payload += pack_smallest_three(rotations).astype("<u4").tobytes()
+    return encode_packet(RGBP_POSE, RGBP_FLAG_PACKED | RGBP_FLAG_BLENDER_SPACE, name, frame, len(positions) // 3, payload)
+
+def encode_pose_delta_packet(name, frame, bone_count, keyframe_sequence, changed, offsets, rotations):
+    payload = RGBP_DELTA_HEADER.pack(keyframe_sequence, DELTA_POSITION_QUANTUM, len(changed))
+    payload += changed.astype("<u2").tobytes() + offsets.astype("<i2").tobytes() + rotations.astype("<i2").tobytes()
+    return encode_packet(RGBP_POSE_DELTA, RGBP_FLAG_BLENDER_SPACE, name, frame, bone_count, payload)
+
+def pose_components(cache, bones):
+    # Unit scale and sign flips are left to the receiver, see RGBP_FLAG_BLENDER_SPACE
+    bones.foreach_get("location", cache.positions)
+    bones.foreach_get("rotation_quaternion", cache.rotations)
+    # foreach_get reads w first
+    cache.rotations.reshape(-1, 4)[:] = cache.rotations.reshape(-1, 4)[:, [1, 2, 3, 0]]
+    return cache.positions, cache.rotations
+
+class ArmatureSnapshot:
+    # Everything the send thread needs to encode an armature, copied out of Blender on the main thread.
+    # The cache replaces its name lists and format string when it is rebuilt rather than changing them, so they are shared
+    def __init__(self, name, cache, with_skeleton, changed):
+        self.name = name
+        self.names = cache.names
+        self.parents = cache.parents
+        self.text_format = cache.text_format
+        self.with_skeleton = with_skeleton
+        self.positions = cache.positions.copy()
+        self.rotations = cache.rotations.copy()
+        # Indices of the bones to send, None for all of them
+        self.changed = changed
+
+def dirty_bones(cache, positions, rotations, epsilons):
+    # Bones that moved past (position, rotation) epsilons since they were last sent, None when all of them must be sent
+    if epsilons is None or cache.sent_positions is None:
+        return None
+    position_epsilon, rotation_epsilon = epsilons
+    moved = numpy.abs(positions - cache.sent_positions).reshape(-1, 3).max(axis=1) > position_epsilon
+    turned = numpy.abs(rotations - cache.sent_rotations).reshape(-1, 4).max(axis=1) > rotation_epsilon
+    return numpy.flatnonzero(moved | turned)
+
+def remember_sent(cache, positions, rotations, changed=None):
+    if changed is None or cache.sent_positions is None:
+        cache.sent_positions = positions.copy()
+        cache.sent_rotations = rotations.copy()
+    else:
+        cache.sent_positions.reshape(-1, 3)[changed] = positions.reshape(-1, 3)[changed]
+        cache.sent_rotations.reshape(-1, 4)[changed] = rotations.reshape(-1, 4)[changed]
+
+def armature_snapshot(name, with_skeleton, epsilons=None, partial=False):
+    # Reads the pose on the main thread, None when epsilons are given and no bone moved past them.
+    # Only partial senders get the moved bones in changed, the others always send whole poses
+    cache = bone_cache(name, with_skeleton)
+    positions, rotations = read_pose(name, cache)
+    changed = dirty_bones(cache, positions, rotations, epsilons)
+    if changed is not None and len(changed) == 0:
+        return None
+    if not partial:
+        changed = None
+    remember_sent(cache, positions, rotations, changed)
+    return ArmatureSnapshot(name, cache, with_skeleton, changed)
+
+def read_pose(name, cache):
+    # Fills the buffers once per send_frame call, the change check and the snapshot share the read
+    if cache.read_frame != pose_read_count:
+        pose_components(cache, bpy.data.objects[name].pose.bones)
+        cache.read_frame = pose_read_count
+    return cache.positions, cache.rotations
+
+def skeleton_packet(snapshot):
+    return encode_skeleton_packet(snapshot.name, snapshot.names, snapshot.parents)
+
+def armature_binary_packets(snapshot, half, packed=False):
+    name = snapshot.name
+    packets = [skeleton_packet(snapshot)] if snapshot.with_skeleton else []
+    if packed:
+        packets.append(encode_packed_pose_packet(name, next_sequence(name), snapshot.positions, snapshot.rotations))
+    else:
+        packets.append(encode_pose_packet(name, next_sequence(name), snapshot.positions, snapshot.rotations, half))
+    return packets
+
+def delta_bones(positions, rotations, keyframe, position_threshold, rotation_threshold):
+    # Bones that moved past a threshold since the keyframe, None when an offset no longer fits in 16 bits
+    _, key_positions, key_rotations = keyframe
+    offsets = positions.reshape(-1, 3) - key_positions.reshape(-1, 3)
+    turns = rotations.reshape(-1, 4) - key_rotations.reshape(-1, 4)
+    changed = numpy.flatnonzero((numpy.abs(offsets).max(axis=1) > position_threshold) | (numpy.abs(turns).max(axis=1) > rotation_threshold))
+    steps = numpy.rint(offsets[changed] / DELTA_POSITION_QUANTUM)
+    if numpy.abs(steps).max(initial=0.0) > 32767:
+        return None
+    quantised = numpy.rint(numpy.clip(rotations.reshape(-1, 4)[changed], -1.0, 1.0) * 32767)
+    return changed, steps, quantised
+
+def armature_delta_packets(snapshot, position_threshold, rotation_threshold, keyframe_interval):
+    name = snapshot.name
+    positions = snapshot.positions
+    rotations = snapshot.rotations
+    packets = [skeleton_packet(snapshot)] if snapshot.with_skeleton else []
+    sequence = next_sequence(name)
+    keyframe = keyframes.get(name)
+    delta = None
+    if keyframe is not None and len(keyframe[1]) == len(positions) and (sequence - keyframe[0]) & 0xFFFFFFFF < keyframe_interval:
+        # The threshold is set in centimetres, positions are in metres
+        delta = delta_bones(positions, rotations, keyframe, position_threshold / 100.0, rotation_threshold)
+    if delta is None:
+        keyframes[name] = (sequence, positions, rotations)
+        packets.append(encode_pose_packet(name, sequence, positions, rotations, False, keyframe=True))
+    else:
+        changed, offsets, quantised = delta
+        packets.append(encode_pose_delta_packet(name, sequence, len(snapshot.names), keyframe[0], changed, offsets, quantised))
+    return packets
+
+def armature_text_entry(snapshot):
+    # Same components as the binary path, scaled to centimetres and flipped here since text has no receiver side conversion.
+    # A snapshot of some of the bones is sent as a P_ entry
+    name = snapshot.name
+    values = numpy.empty((len(snapshot.names), 7))
+    values[:, :3] = snapshot.positions.reshape(-1, 3) * 100.0
+    values[:, 3:] = snapshot.rotations.reshape(-1, 4) * TEXT_ROTATION_SIGNS
+    entry = hierarchy_entry(snapshot) if snapshot.with_skeleton else ""
+    entry += stamp_entry(name)
+    changed = snapshot.changed
+    if changed is None or len(changed) == len(snapshot.names):
+        return entry + "A_" + name + "=" + snapshot.text_format % tuple(values.ravel().tolist()) + "|"
+    return entry + "P_" + name + "=" + "".join(BONE_TEXT_FORMAT % ((snapshot.names[i],) + tuple(values[i].tolist())) for i in changed) + "|"
+
+def object_snapshot(name):
+    # World transform, so objects in any rotation mode or parented to others stream the same way as bones
+    location, rotation, scale = bpy.data.objects[name].matrix_world.decompose()
+    location = location * 100.0
+    return name, (location.x, location.y, location.z, -rotation.x, rotation.y, -rotation.z, rotation.w)
+
+def object_entry(snapshot):
+    name, values = snapshot
+    return stamp_entry(name) + "O_" + name + "=(" + ",".join("{:.9f}".format(value) for value in values) + ")||"
+
+def stamp_entry(name):
+    return "S_=" + str(next_sequence(name)) + "," + str(send_time_us) + "||"
+
+def send_datagram(sock, addr, message):
+    # Messages over MAX_DATAGRAM_SIZE go out as one fragment packet per chunk
+    global message_id
+    if len(message) <= MAX_DATAGRAM_SIZE:
+        sock.sendto(message, addr)
+        return
+    chunk_count = (len(message) + FRAGMENT_CHUNK_SIZE - 1) // FRAGMENT_CHUNK_SIZE
+    for index in range(chunk_count):
+        offset = index * FRAGMENT_CHUNK_SIZE
+        chunk = message[offset:offset + FRAGMENT_CHUNK_SIZE]
+        payload = RGBP_FRAGMENT_HEADER.pack(message_id, len(message), offset, index, chunk_count) + chunk
+        sock.sendto(encode_packet(RGBP_FRAGMENT, 0, "", 0, 0, payload), addr)
+    message_id = (message_id + 1) & 0xFFFFFFFF
+
+def send_packets(sock, addr, packets):
+    datagram = b""
+    for packet in packets:
+        if datagram and len(datagram) + len(packet) > MAX_DATAGRAM_SIZE:
+            send_datagram(sock, addr, datagram)
+            datagram = b""
+        datagram += packet
+    if datagram:
+        send_datagram(sock, addr, datagram)
+
 def Sub_update(self,context):
         mytool=context.scene.my_tool
         list=bpy.context.selected_objects
@@ -100,6 +398,73 @@ class MyProperties(bpy.types.PropertyGroup):
         items = [("BC","Bone Control (Individual Animation)",""),
         ("AN","Simultaneous Animation","")]
     )
+
+    my_enum3 : bpy.props.EnumProperty(
+        name = "Wire Format",
+        description = "Text is understood by every receiver, binary is smaller and faster to decode",
+        items = [("TXT","Text",""),
+        ("BIN","Binary",""),
+        ("HALF","Binary (Half Precision)",""),
+        ("PACKED","Binary (Packed)",""),
+        ("DELTA","Binary (Keyframe + Delta)","")]
+    )
+
+    my_delta_position : bpy.props.FloatProperty(
+        name = "Delta Position Threshold",
+        description = "Bones that moved less than this many centimetres since the last keyframe are not resent",
+        default = 0.05,
+        min = 0.0
+    )
+
+    my_delta_rotation : bpy.props.FloatProperty(
+        name = "Delta Rotation Threshold",
+        description = "Bones whose quaternion components changed less than this since the last keyframe are not resent",
+        default = 0.0005,
+        min = 0.0
+    )
+
+    my_change_position : bpy.props.FloatProperty(
+        name = "Change Position Epsilon",
+        description = "With simultaneous animation, bones that moved less than this many centimetres since they were last sent are not sent",
+        default = 0.01,
+        min = 0.0
+    )
+
+    my_change_rotation : bpy.props.FloatProperty(
+        name = "Change Rotation Epsilon",
+        description = "With simultaneous animation, bones whose quaternion components changed less than this since they were last sent are not sent",
+        default = 0.0001,
+        min = 0.0
+    )
+
+    my_send_mode : bpy.props.EnumProperty(
+        name = "Send On",
+        description = "What triggers a send, frames are only sent when a pose has changed",
+        items = [("DEPSGRAPH","Scene Update","Every depsgraph update, including frame changes, posing and playback"),
+        ("FRAME","Frame Change","Only when the scene frame changes"),
+        ("TIMER","Free Running","At a fixed rate, independent of the scene")]
+    )
+
+    my_send_rate : bpy.props.IntProperty(
+        name = "Send Rate",
+        description = "Frames per second checked for changes in free running mode",
+        default = 60,
+        min = 1,
+        max = 120
+    )
+
+    my_debug_log : bpy.props.BoolProperty(
+        name = "Log Payloads",
+        description = "Print every frame sent to the system console, slows the sender down",
+        default = False
+    )
+
+    my_keyframe_interval : bpy.props.IntProperty(
+        name = "Keyframe Interval",
+        description = "Frames between two full poses, the ones in between only carry the bones that changed",
+        default = 30,
+        min = 1
+    )
     
     my_string : bpy.props.EnumProperty(
         name = "Subjects",
@@ -131,107 +496,277 @@ class BlenderUELiveLink(bpy.types.Panel):
         layout.prop(mytool,"my_enum")
         layout.prop(mytool,"my_enum1")
         layout.prop(mytool,"my_enum2")
+        layout.prop(mytool,"my_enum3")
+        if mytool.my_enum2=="AN":
+            layout.prop(mytool,"my_change_position")
+            layout.prop(mytool,"my_change_rotation")
+        layout.prop(mytool,"my_send_mode")
+        if mytool.my_send_mode=="TIMER":
+            layout.prop(mytool,"my_send_rate")
+        layout.prop(mytool,"my_debug_log")
+        if mytool.my_enum3=="DELTA":
+            layout.prop(mytool,"my_delta_position")
+            layout.prop(mytool,"my_delta_rotation")
+            layout.prop(mytool,"my_keyframe_interval")
         layout.prop(mytool,"my_string")
         row=layout.row()
         row.operator(AddSubjects.bl_idname, text="Add subjects")
         row=layout.row()
         row.operator(RemoveSubjects.bl_idname, text="Remove subject")      
         row=layout.row()
-        row.operator("wm.modal_timer_operator", text="Start Live Link")
+        if sender.running:
+            row.operator(StopLiveLink.bl_idname, text="Stop Live Link")
+        else:
+            row.operator(StartLiveLink.bl_idname, text="Start Live Link")
         # row=layout.row()
         # row.prop(context.scene, prop_name)
 
-message1=""
-class ModalTimerOperator(bpy.types.Operator):
-    """Operator which runs its self from a timer"""
-    bl_idname = "wm.modal_timer_operator"
-    bl_label = "Modal Timer Operator"
-    bl_options = {"UNDO"}
+class SendFrame:
+    # One frame as the main thread snapshotted it, encoded and sent by the send thread
+    def __init__(self, mytool, send_time):
+        self.send_time = send_time
+        self.wire_format = mytool.my_enum3
+        self.delta_settings = (mytool.my_delta_position, mytool.my_delta_rotation, mytool.my_keyframe_interval)
+        self.debug = mytool.my_debug_log
+        self.armatures = []
+        self.objects = []
+
+class SendThread:
+    """Encodes and sends frames off Blender's main thread, fed through a bounded queue"""
+    # Frames waiting to be sent, the oldest is dropped when the sender falls behind
+    depth = 4
+
+    def __init__(self, sock, addr):
+        self.sock = sock
+        self.addr = addr
+        self.frames = queue.Queue(maxsize=self.depth)
+        self.thread = threading.Thread(target=self.run, name="LiveLinkSend", daemon=True)
+        self.dropped = 0
+
+    def start(self):
+        self.thread.start()
+
+    def stop(self):
+        # Waits a moment for the queued frames, the thread may still be encoding when this returns, see join
+        self.push(None)
+        self.thread.join(1.0)
+
+    def join(self):
+        # The encoding state is module wide, a new send thread must not start before the last one is done with it
+        self.thread.join()
+
+    def push(self, frame):
+        # Returns True if an older frame had to be dropped to make room
+        dropped = False
+        while True:
+            try:
+                self.frames.put_nowait(frame)
+                return dropped
+            except queue.Full:
+                try:
+                    self.frames.get_nowait()
+                    self.dropped += 1
+                    dropped = True
+                except queue.Empty:
+                    pass
+
+    def run(self):
+        while True:
+            frame = self.frames.get()
+            if frame is None:
+                # The state frames are encoded against belongs to this thread, it is cleared here so a stop that
+                # stopped waiting for a slow frame cannot pull it away mid-encode
+                keyframes.clear()
+                return
+            try:
+                self.send(frame)
+            except Exception:
+                traceback.print_exc()
+
+    def send(self, frame):
+        global send_time_us
+        send_time_us = frame.send_time
+        if frame.wire_format != "TXT" and frame.armatures:
+            packets = []
+            for snapshot in frame.armatures:
+                if frame.wire_format=="DELTA":
+                    packets += armature_delta_packets(snapshot, *frame.delta_settings)
+                else:
+                    packets += armature_binary_packets(snapshot, frame.wire_format=="HALF", frame.wire_format=="PACKED")
+            send_packets(self.sock, self.addr, packets)
+            if frame.debug:
+                print("LiveLink: sent %d packets, %d bytes" % (len(packets), sum(len(packet) for packet in packets)))
+            return
+        message = "".join(armature_text_entry(snapshot) for snapshot in frame.armatures)
+        message += "".join(object_entry(snapshot) for snapshot in frame.objects)
+        if message:
+            if frame.debug:
+                print(message)
+            send_datagram(self.sock, self.addr, message.encode())
+
+class LiveLinkSender:
+    """Snapshots frames from scene handlers or its own timer, skipping those where nothing moved, for the send thread"""
     host = "127.0.0.1" # set to IP address of target computer
     port = 2000
     addr = (host, port)
-    UDPSock = socket(AF_INET, SOCK_DGRAM) 
-    _timer = None      
-    
-    def modal(self, context, event):
-        mytool = context.scene.my_tool
-        if event.type in {'RIGHTMOUSE', 'ESC'}:
-            self.cancel(context)
-            sub.clear()
-            sub_names.clear()
-            names.clear()
-            return {'CANCELLED'}
-        if event.type == 'TIMER':
-            #bpy.data.objects["Cube"] 
-            global message1
-            if(mytool.my_enum=="O"):
-                message1 = mytool.my_enum + "_"+mytool.my_string+"="
-                message1+="(" + str(bpy.data.objects[mytool.my_string].location.x) + "," + str(bpy.data.objects[mytool.my_string].location.y) +  "," + str(bpy.data.objects[mytool.my_string].location.z) +  "," + str(bpy.data.objects[mytool.my_string].rotation_quaternion.x) +  "," + str(bpy.data.objects[mytool.my_string].rotation_quaternion.y )+  "," + str(bpy.data.objects[mytool.my_string].rotation_quaternion.z) + "," + str(bpy.data.objects[mytool.my_string].rotation_quaternion.w)+ ")" + "||"
-                            
-            elif(mytool.my_enum=="A" and mytool.my_enum2=="BC"):
-                count = 0
-                message1 = mytool.my_enum + "_"+mytool.my_string+"="
-                for i in bpy.data.objects[mytool.my_string].pose.bones:
-                    #if(count < 3):
-                    #    count = count + 1
-                    #else:
-                    #    break
-                    #boneEdit = bpy.data.armatures['root'].bones[i.name].matrix_local.to_quaternion()
-                    obj = i.id_data
-                    matrix_final = obj.matrix_world @ i.matrix
-                    locationWS = i.location * 100.0
-                    quaternionWS =i.rotation_quaternion# matrix_final.to_quaternion()
-                    #quaternionWS = i.rotation_quaternion * boneEdit
-                    #print(quaternionWS)
-                    #mixamo bone name conversion
-                    bone_name=i.name
-                    split_name=bone_name.split(":")[-1]
-                    message1+=split_name + ":(" + "{:.9f}".format(locationWS.x)+ "," + "{:.9f}".format(locationWS.y) +  "," + "{:.9f}".format(locationWS.z) +  "," + "{:.9f}".format(-quaternionWS.x) +  "," + "{:.9f}".format(quaternionWS.y)+  "," + "{:.9f}".format(-quaternionWS.z)+ "," + "{:.9f}".format(quaternionWS.w)+ ")" + "|"
-                message1 = message1 + "|"
-            
-            elif(mytool.my_enum=="A" and mytool.my_enum2=="AN"):
-               for j in names:
-                  message1+=mytool.my_enum + "_"+j+"="
-                  for i in bpy.data.objects[j].pose.bones:
-                      obj = i.id_data
-                      matrix_final = obj.matrix_world @ i.matrix
-                      locationWS = i.location * 100.0
-                      quaternionWS =i.rotation_quaternion
-                      #mixamo bone name conversion
-                      bone_name=i.name
-                      split_name=bone_name.split(":")[-1]
-                      message1+=split_name + ":(" + "{:.9f}".format(locationWS.x)+ "," + "{:.9f}".format(locationWS.y) +  "," + "{:.9f}".format(locationWS.z) +  "," + "{:.9f}".format(-quaternionWS.x) +  "," + "{:.9f}".format(quaternionWS.y)+  "," + "{:.9f}".format(-quaternionWS.z)+ "," + "{:.9f}".format(quaternionWS.w)+ ")" + "|"
-                  message1 = message1 + "|"
-            message=message1
-            print(message)   
-            self.UDPSock.sendto(message.encode(), self.addr)
-            message1=""
-            # change theme color, silly!
-            color = context.preferences.themes[0].view_3d.space.gradients.high_gradient
-            color.s = 1.0
-            color.h += 0.01
-            
-        return {'PASS_THROUGH'}
+    # Frames are resent at least this often while nothing moves, so a receiver started late still gets the subjects
+    keepalive_seconds = 1.0
+
+    def __init__(self):
+        self.UDPSock = socket(AF_INET, SOCK_DGRAM)
+        self.send_thread = None
+        # Stopped send thread that may still be finishing its last frames
+        self.stopped_thread = None
+        self.running = False
+        self.mode = None
+        self.interval = 0.0
+        self.last_signature = None
+        self.last_send_time = 0.0
+        # Bound once, handler and timer lists are searched by identity when they are removed
+        self.scene_callback = self.on_scene
+        self.timer_callback = self.on_timer
+
+    def start(self, scene):
+        mytool = scene.my_tool
+        self.mode = mytool.my_send_mode
+        self.interval = 1.0 / mytool.my_send_rate
+        self.last_signature = None
+        if self.stopped_thread is not None:
+            self.stopped_thread.join()
+            self.stopped_thread = None
+        self.send_thread = SendThread(self.UDPSock, self.addr)
+        self.send_thread.start()
+        if self.mode == "TIMER":
+            bpy.app.timers.register(self.timer_callback)
+        else:
+            bpy.app.handlers.frame_change_post.append(self.scene_callback)
+            if self.mode == "DEPSGRAPH":
+                bpy.app.handlers.depsgraph_update_post.append(self.scene_callback)
+        self.running = True
+
+    def stop(self):
+        if self.mode == "TIMER":
+            if bpy.app.timers.is_registered(self.timer_callback):
+                bpy.app.timers.unregister(self.timer_callback)
+        else:
+            for handlers in (bpy.app.handlers.frame_change_post, bpy.app.handlers.depsgraph_update_post):
+                if self.scene_callback in handlers:
+                    handlers.remove(self.scene_callback)
+        # Frames already queued are sent first, the send thread clears its own state once it is done with them.
+        # What is cleared here is only read on the main thread, snapshots carry copies of it
+        self.send_thread.stop()
+        self.stopped_thread = self.send_thread
+        self.send_thread = None
+        self.running = False
+        sub.clear()
+        sub_names.clear()
+        names.clear()
+        announced_subjects.clear()
+        bone_caches.clear()
+
+    def on_scene(self, scene, depsgraph=None):
+        self.send_frame(scene)
+
+    def on_timer(self):
+        self.send_frame(bpy.context.scene)
+        return self.interval
+
+    def signature(self, mytool, subjects):
+        # Raw bytes of everything the frame would send, compared against the last frame sent
+        parts = [(mytool.my_enum + mytool.my_enum3).encode()]
+        for name in subjects:
+            if name not in bpy.data.objects:
+                continue
+            if mytool.my_enum == "A":
+                cache = bone_cache(name)
+                positions, rotations = read_pose(name, cache)
+                parts += (positions.tobytes(), rotations.tobytes())
+            else:
+                parts.append(struct.pack("<16f", *[value for row in bpy.data.objects[name].matrix_world for value in row]))
+        return b"".join(parts)
+
+    def send_frame(self, scene):
+        # Runs on Blender's main thread, so it only reads the scene, encoding and sending happen on the send thread
+        global frame_number, pose_read_count
+        pose_read_count += 1
+        mytool = scene.my_tool
+        subjects = [mytool.my_string] if mytool.my_enum2=="BC" else names
+        now = time.perf_counter()
+        signature = self.signature(mytool, subjects)
+        keepalive = signature == self.last_signature
+        if keepalive and now - self.last_send_time < self.keepalive_seconds:
+            return
+        self.last_signature = signature
+        self.last_send_time = now
+        frame = SendFrame(mytool, time.perf_counter_ns() // 1000)
+        # With several armatures only the ones that moved are sent, keepalive frames resend everything
+        epsilons = None
+        if mytool.my_enum2=="AN" and not keepalive:
+            epsilons = (mytool.my_change_position / 100.0, mytool.my_change_rotation)
+        if(mytool.my_enum=="A"):
+            for j in subjects:
+                snapshot = armature_snapshot(j, skeleton_due(j), epsilons, mytool.my_enum3=="TXT")
+                if snapshot is not None:
+                    frame.armatures.append(snapshot)
+        elif(mytool.my_enum=="O"):
+            frame.wire_format = "TXT"
+            frame.objects = [object_snapshot(j) for j in subjects]
+        frame_number += 1
+        if self.send_thread.push(frame):
+            # The dropped frame may have carried the only copy of some bones, the next frame sends every bone again
+            for cache in bone_caches.values():
+                cache.sent_positions = None
+                cache.sent_rotations = None
+
+sender = LiveLinkSender()
+
+class StartLiveLink(bpy.types.Operator):
+    """Start streaming the subjects to Unreal"""
+    bl_idname = "wm.livelink_start"
+    bl_label = "Start Live Link"
+
+    @classmethod
+    def poll(cls, context):
+        return not sender.running
+
+    def execute(self, context):
+        sender.start(context.scene)
+        return {'FINISHED'}
+
+class StopLiveLink(bpy.types.Operator):
+    """Stop streaming and forget the subjects"""
+    bl_idname = "wm.livelink_stop"
+    bl_label = "Stop Live Link"
+
+    @classmethod
+    def poll(cls, context):
+        return sender.running
 
     def execute(self, context):
-        wm = context.window_manager
-        self._timer = wm.event_timer_add(0.1, window=context.window)
-        wm.modal_handler_add(self)
-        return {'RUNNING_MODAL'}
+        sender.stop()
+        return {'FINISHED'}
+
 
-    def cancel(self, context):
-        wm = context.window_manager
-        wm.event_timer_remove(self._timer)
 
+classes = [AddSubjects,RemoveSubjects,MyProperties,BlenderUELiveLink,StartLiveLink,StopLiveLink]
 
+@persistent
+def reset_on_load(dummy):
+    # Loading a file removes the handlers and timer and the subjects belong to the old file, so the sender is stopped
+    if sender.running:
+        sender.stop()
 
-classes = [AddSubjects,RemoveSubjects,MyProperties,BlenderUELiveLink,ModalTimerOperator]
 def register():
     for cls in classes:
         bpy.utils.register_class(cls)
     bpy.types.Scene.my_tool = bpy.props.PointerProperty(type = MyProperties)
+    bpy.app.handlers.load_post.append(reset_on_load)
 
 def unregister():
+    if reset_on_load in bpy.app.handlers.load_post:
+        bpy.app.handlers.load_post.remove(reset_on_load)
+    if sender.running:
+        sender.stop()
     for cls in classes:
         bpy.utils.unregister_class(cls)
     del bpy.types.Scene.my_tool
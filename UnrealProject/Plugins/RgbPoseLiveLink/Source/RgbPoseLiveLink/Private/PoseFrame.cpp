@@ -1,72 +1,331 @@
 ﻿#include "PoseFrame.h"
 
+namespace PoseFrameParsing
+{
+	// Powers of ten that are exactly representable as a double
+	static const double ExactPowersOfTen[] =
+	{
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	// Largest mantissa a double holds exactly
+	static const uint64 MaxExactMantissa = 1ull << 53;
 
+	static const ANSICHAR* Find(const ANSICHAR* Begin, const ANSICHAR* End, ANSICHAR Separator)
+	{
+		while (Begin < End && *Begin != Separator)
+		{
+			Begin++;
+		}
+		return Begin;
+	}
+
+	static const ANSICHAR* FindEntryEnd(const ANSICHAR* Begin, const ANSICHAR* End)
+	{
+		for (const ANSICHAR* Cursor = Begin; Cursor + 1 < End; Cursor++)
+		{
+			if (Cursor[0] == '|' && Cursor[1] == '|')
+			{
+				return Cursor;
+			}
+		}
+		return End;
+	}
+
+	static FName MakeName(const ANSICHAR* Begin, const ANSICHAR* End)
+	{
+		// Short names convert on the stack, FName then only looks the entry up in the name table
+		FUTF8ToTCHAR Converted(Begin, (int32)(End - Begin));
+		return FName(Converted.Length(), Converted.Get());
+	}
+
+	static bool IsDigit(ANSICHAR Char)
+	{
+		return Char >= '0' && Char <= '9';
+	}
+
+	static bool IsWhitespace(ANSICHAR Char)
+	{
+		return Char == ' ' || Char == '\t' || Char == '\r' || Char == '\n';
+	}
 
-PoseFrame::PoseFrame(TArray<FString> PoseFrameArray)
+	static int32 ParseInt(const ANSICHAR* Begin, const ANSICHAR* End)
+	{
+		while (Begin < End && IsWhitespace(*Begin))
+		{
+			Begin++;
+		}
+		const bool bNegative = Begin < End && *Begin == '-';
+		Begin += bNegative ? 1 : 0;
+		int32 Value = 0;
+		for (; Begin < End && IsDigit(*Begin); Begin++)
+		{
+			Value = Value * 10 + (*Begin - '0');
+		}
+		return bNegative ? -Value : Value;
+	}
+
+	static uint64 ParseUInt64(const ANSICHAR* Begin, const ANSICHAR* End)
+	{
+		uint64 Value = 0;
+		for (; Begin < End && IsDigit(*Begin); Begin++)
+		{
+			Value = Value * 10 + (*Begin - '0');
+		}
+		return Value;
+	}
+
+	static float SlowParseFloat(const ANSICHAR* Begin, const ANSICHAR* End)
+	{
+		TCHAR Buffer[64];
+		const int32 Length = FMath::Min((int32)(End - Begin), (int32)UE_ARRAY_COUNT(Buffer) - 1);
+		for (int32 Index = 0; Index < Length; Index++)
+		{
+			Buffer[Index] = TCHAR(uint8(Begin[Index]));
+		}
+		Buffer[Length] = 0;
+		return FCString::Atof(Buffer);
+	}
+}
+
+bool PoseFrame::ParseText(const uint8* Data, int32 Num)
+{
+	return ParseText(Data, Num, [](FName, const FPoseFrameStamp&) { return true; });
+}
+
+bool PoseFrame::ParseText(const uint8* Data, int32 Num, TFunctionRef<bool(FName, const FPoseFrameStamp&)> AcceptStamp)
 {
-	for (int i = 0; i < PoseFrameArray.Num(); i++)
+	using namespace PoseFrameParsing;
+
+	ObjectNames.Reset();
+	ObjectTransforms.Reset();
+	ObjectStamps.Reset();
+	NumSubjects = 0;
+	BoneParents.Reset();
+	FPoseFrameStamp Stamp;
+
+	const ANSICHAR* Cursor = reinterpret_cast<const ANSICHAR*>(Data);
+	const ANSICHAR* End = Cursor + Num;
+
+	while (Cursor < End)
 	{
-		//		O_Cube:(1.0,2.0,3.0,4.0,5.0,6.0,7.0)||
-		//		A_Skeleton1:Bone1:(8.0,9.0,10.0,11.0,12.0,13.0,14.0)|
+		//		O_Cube=(1.0,2.0,3.0,4.0,5.0,6.0,7.0)||
+		//		A_Skeleton1=Bone1:(8.0,9.0,10.0,11.0,12.0,13.0,14.0)|
 		//					Bone2:(15.0,16.0,17.0,18.0,19.0,20.0,21.0)|
 		//					Bone3:(22.0,23.0,24.0,25.0,26.0,27.0,28.0)||
+		//		H_Skeleton1=-1,0,1||
+		//		S_=42,1234567||O_Cube=(1.0,2.0,3.0,4.0,5.0,6.0,7.0)||
+		//		P_Skeleton1=Bone2:(15.0,16.0,17.0,18.0,19.0,20.0,21.0)||
+		const ANSICHAR* EntryEnd = FindEntryEnd(Cursor, End);
+		if (EntryEnd == Cursor) break;
 
-		if (PoseFrameArray[i].IsEmpty()) break;
-		FString PoseFrameElementString = PoseFrameArray[i]; //rForearmBend:(13.93308, 32.54413, -24.76695)
-		TArray<FString> PoseFrameKeyValuePair;
-		PoseFrameElementString.ParseIntoArray(PoseFrameKeyValuePair, TEXT("="), false);
-		char* name = TCHAR_TO_UTF8(*PoseFrameKeyValuePair[0]);
-		
-		//Check name is a skeleton or object
-		if (name[0] == 'O' && name[1] == '_') {
-			//OBject 
-			FString vec = TCHAR_TO_UTF8(*PoseFrameKeyValuePair[1]); 
-			FTransform objectTransform = ConvertToTransform(vec);
-			//Save the object name and its transform
-			ObjectName_TransformMap.Add( name, objectTransform);
-		}
-		else if (name[0] == 'A' && name[1] == '_') {
-			//Armature 
-			//PoseFrameKeyValuePair[0].RemoveAt(0);
-			TArray<FString> SubnameArr;
-			PoseFrameKeyValuePair[0].ParseIntoArray(SubnameArr, TEXT("_"), false);
-			Subjectname = SubnameArr[1];
-			TArray<FString> BoneNameTransformPair;
-			PoseFrameKeyValuePair[1].ParseIntoArray(BoneNameTransformPair, TEXT("|"), false);
-			for (size_t j = 0; j < BoneNameTransformPair.Num(); j++)
+		const ANSICHAR* NameEnd = Find(Cursor, EntryEnd, '=');
+		const ANSICHAR* Value = NameEnd + 1;
+		const ANSICHAR* ValueEnd = Find(FMath::Min(Value, EntryEnd), EntryEnd, '=');
+
+		if (NameEnd - Cursor >= 2 && Cursor[1] == '_' && Value <= EntryEnd)
+		{
+			if (Cursor[0] == 'O')
+			{
+				//Object
+				const FName ObjectName = MakeName(Cursor + 2, NameEnd);
+				FTransform ObjectTransform;
+				if ((!Stamp.IsStamped() || AcceptStamp(ObjectName, Stamp)) && ConvertToTransform(Value, ValueEnd, ObjectTransform))
+				{
+					ObjectNames.Add(ObjectName);
+					ObjectTransforms.Add(ObjectTransform);
+					ObjectStamps.Add(Stamp);
+				}
+				Stamp = FPoseFrameStamp();
+			}
+			else if (Cursor[0] == 'A' || Cursor[0] == 'P')
 			{
-				//FString PoseFrameElementString = BoneNameTransformPair[j]; //rForearmBend:(13.93308, 32.54413, -24.76695)
-				TArray<FString> BoneNameTransformPairSplitArr;
-				BoneNameTransformPair[j].ParseIntoArray(BoneNameTransformPairSplitArr, TEXT(":"), false);
-				char* boneName= TCHAR_TO_UTF8(*BoneNameTransformPairSplitArr[0]);
-				FString vec = TCHAR_TO_UTF8(*BoneNameTransformPairSplitArr[1]);
-				FTransform boneTransform = ConvertToTransform(vec);
-				//Save the bone name and its transform in a different array 
-				BoneName_TransformMap.Add(boneName,boneTransform);
+				//Armature, rejected frames are skipped without reading their bones
+				const bool bPartial = Cursor[0] == 'P';
+				const FName SubjectName = MakeName(Cursor + 2, NameEnd);
+				const FPoseFrameStamp SubjectStamp = Stamp;
+				Stamp = FPoseFrameStamp();
+				FPoseFrameSubjectState* State = SubjectStates.Find(SubjectName);
+				if ((bPartial && State == nullptr) || (SubjectStamp.IsStamped() && !AcceptStamp(SubjectName, SubjectStamp)))
+				{
+					Cursor = EntryEnd + 2;
+					continue;
+				}
+
+				//Subjects past the last frame's count reuse the arrays of earlier frames
+				if (NumSubjects == Subjects.Num())
+				{
+					Subjects.AddDefaulted();
+				}
+				FPoseFrameSubject& Subject = Subjects[NumSubjects++];
+				Subject.Name = SubjectName;
+				Subject.Stamp = SubjectStamp;
+				Subject.BoneNames.Reset();
+				Subject.BoneTransforms.Reset();
+				const ANSICHAR* Bone = Value;
+				while (Bone < ValueEnd)
+				{
+					//rForearmBend:(13.93308,32.54413,-24.76695,0.0,0.0,0.0,1.0)
+					const ANSICHAR* BoneEnd = Find(Bone, ValueEnd, '|');
+					const ANSICHAR* BoneNameEnd = Find(Bone, BoneEnd, ':');
+					if (BoneNameEnd < BoneEnd)
+					{
+						const ANSICHAR* TransformEnd = Find(BoneNameEnd + 1, BoneEnd, ':');
+						FTransform BoneTransform;
+						if (ConvertToTransform(BoneNameEnd + 1, TransformEnd, BoneTransform))
+						{
+							//Save the bone name and its transform
+							Subject.BoneNames.Add(MakeName(Bone, BoneNameEnd));
+							Subject.BoneTransforms.Add(BoneTransform);
+						}
+					}
+					Bone = BoneEnd + 1;
+				}
+
+				if (bPartial)
+				{
+					//Moved bones go into the last full pose, which is output as the subject
+					for (int32 BoneIndex = 0; BoneIndex < Subject.BoneNames.Num(); BoneIndex++)
+					{
+						if (const int32* StateIndex = State->BoneIndices.Find(Subject.BoneNames[BoneIndex]))
+						{
+							State->BoneTransforms[*StateIndex] = Subject.BoneTransforms[BoneIndex];
+						}
+					}
+					Subject.BoneNames = State->BoneNames;
+					Subject.BoneTransforms = State->BoneTransforms;
+				}
+				else
+				{
+					//Full poses replace the state, the name lookup is only rebuilt when the bone list changes
+					if (State == nullptr)
+					{
+						State = &SubjectStates.Add(SubjectName);
+					}
+					if (State->BoneNames != Subject.BoneNames)
+					{
+						State->BoneNames = Subject.BoneNames;
+						State->BoneIndices.Reset();
+						for (int32 BoneIndex = 0; BoneIndex < State->BoneNames.Num(); BoneIndex++)
+						{
+							State->BoneIndices.Add(State->BoneNames[BoneIndex], BoneIndex);
+						}
+					}
+					State->BoneTransforms = Subject.BoneTransforms;
+				}
+			}
+			else if (Cursor[0] == 'H')
+			{
+				//Hierarchy, sent once per skeleton rather than with every pose
+				TArray<int32>& Parents = BoneParents.Add(MakeName(Cursor + 2, NameEnd));
+				const ANSICHAR* Parent = Value;
+				while (Parent < ValueEnd)
+				{
+					const ANSICHAR* ParentEnd = Find(Parent, ValueEnd, ',');
+					Parents.Add(ParseInt(Parent, ParentEnd));
+					Parent = ParentEnd + 1;
+				}
+			}
+			else if (Cursor[0] == 'S')
+			{
+				//Sender stamp of the next subject, its sequence number and monotonic clock in microseconds
+				const ANSICHAR* SequenceEnd = Find(Value, ValueEnd, ',');
+				if (SequenceEnd < ValueEnd)
+				{
+					Stamp.Sequence = (uint32)ParseUInt64(Value, SequenceEnd);
+					Stamp.SendTimeMicros = ParseUInt64(SequenceEnd + 1, ValueEnd);
+				}
 			}
 		}
+
+		Cursor = EntryEnd + 2;
 	}
+
+	return NumSubjects > 0 || ObjectNames.Num() > 0 || BoneParents.Num() > 0;
 }
 
+bool PoseFrame::ConvertToTransform(const ANSICHAR* Begin, const ANSICHAR* End, FTransform& OutTransform)
+{
+	using namespace PoseFrameParsing;
 
-//PoseFrameMap.Add(name, FVector(x, -y, z));
-//PoseFrameRot.Add(name, FQuat(rx, -ry, rz, rw));
-FTransform PoseFrame::ConvertToTransform(FString transformText) {
 	//Remove the round brackets at end terminals
-	transformText = transformText.RightChop(1);
-	transformText = transformText.LeftChop(1);
-	//Split the array by comma delimiter
-	TArray<FString> vectorElementArray;
-	transformText.ParseIntoArray(vectorElementArray, TEXT(","), false);
-	float x = FCString::Atof(*vectorElementArray[0]);
-	float y = FCString::Atof(*vectorElementArray[1]);
-	float z = FCString::Atof(*vectorElementArray[2]);
-	float rx = FCString::Atof(*vectorElementArray[3]);
-	float ry = FCString::Atof(*vectorElementArray[4]);
-	float rz = FCString::Atof(*vectorElementArray[5]);
-	float rw = FCString::Atof(*vectorElementArray[6]);
-	/*float sx = 100 * FCString::Atof(*vectorElementArray[7]);
-	float sy = 100 * FCString::Atof(*vectorElementArray[8]);
-	float sz = 100 * FCString::Atof(*vectorElementArray[9]);*/
-	return FTransform(FQuat(rx, ry,rz,rw), FVector(x,y, z));
+	if (End - Begin < 2)
+	{
+		return false;
+	}
+	Begin++;
+	End--;
+
+	//Split by comma delimiter
+	float Values[7];
+	for (int32 Index = 0; Index < (int32)UE_ARRAY_COUNT(Values); Index++)
+	{
+		if (Begin > End)
+		{
+			return false;
+		}
+		const ANSICHAR* ElementEnd = Find(Begin, End, ',');
+		Values[Index] = ParseFloat(Begin, ElementEnd);
+		Begin = ElementEnd + 1;
+	}
+
+	OutTransform = FTransform(FQuat(Values[3], Values[4], Values[5], Values[6]), FVector(Values[0], Values[1], Values[2]));
+	return true;
+}
+
+float PoseFrame::ParseFloat(const ANSICHAR* Begin, const ANSICHAR* End)
+{
+	using namespace PoseFrameParsing;
+
+	// Atof rounds the decimal to the nearest double and then to float. While the digits fit in 53 bits and there
+	// are at most 22 decimals, the mantissa and the power of ten are both exact doubles, so a single division
+	// rounds the same way. Anything else (exponents, long mantissas, inf/nan) goes through Atof itself.
+	const ANSICHAR* Cursor = Begin;
+	while (Cursor < End && IsWhitespace(*Cursor))
+	{
+		Cursor++;
+	}
+
+	bool bNegative = false;
+	if (Cursor < End && (*Cursor == '-' || *Cursor == '+'))
+	{
+		bNegative = *Cursor == '-';
+		Cursor++;
+	}
+
+	uint64 Mantissa = 0;
+	int32 NumDigits = 0;
+	int32 NumDecimals = 0;
+	bool bSeenPoint = false;
+	for (; Cursor < End; Cursor++)
+	{
+		const ANSICHAR Char = *Cursor;
+		if (IsDigit(Char))
+		{
+			Mantissa = Mantissa * 10 + (Char - '0');
+			NumDigits++;
+			NumDecimals += bSeenPoint ? 1 : 0;
+			if (Mantissa > MaxExactMantissa || NumDigits > 18)
+			{
+				return SlowParseFloat(Begin, End);
+			}
+		}
+		else if (Char == '.' && !bSeenPoint)
+		{
+			bSeenPoint = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (NumDigits == 0 || NumDecimals >= (int32)UE_ARRAY_COUNT(ExactPowersOfTen) || (Cursor < End && (*Cursor == 'e' || *Cursor == 'E')))
+	{
+		return SlowParseFloat(Begin, End);
+	}
+
+	const double Value = (double)Mantissa / ExactPowersOfTen[NumDecimals];
+	return (float)(bNegative ? -Value : Value);
 }
@@ -1,15 +1,85 @@
 ﻿#pragma once
 
+#include "CoreMinimal.h"
+#include "Templates/Function.h"
+
+/// <summary>
+/// Sequence number and sender clock of the S_ entry in front of a subject's entry
+/// </summary>
+struct FPoseFrameStamp
+{
+    uint32 Sequence = 0;
+    // Microseconds, 0 when the subject was not stamped
+    uint64 SendTimeMicros = 0;
+
+    bool IsStamped() const { return SendTimeMicros != 0; }
+};
+
+/// <summary>
+/// One armature of a datagram, its bone names and their transforms
+/// </summary>
+struct FPoseFrameSubject
+{
+    FName Name;
+    FPoseFrameStamp Stamp;
+    TArray<FName> BoneNames;
+    TArray<FTransform> BoneTransforms;
+};
+
+/// <summary>
+/// Last full pose of an armature. P_ entries only carry the bones that changed and are merged into it
+/// </summary>
+struct FPoseFrameSubjectState
+{
+    TArray<FName> BoneNames;
+    TArray<FTransform> BoneTransforms;
+    TMap<FName, int32> BoneIndices;
+};
+
+/// <summary>
+/// Every subject decoded from a text datagram. A single instance is reused for every datagram, its arrays keep their
+/// capacity between frames so parsing does not allocate once the largest skeletons have been seen.
+/// </summary>
 class PoseFrame
 {
 public:
-    TMap<FString, FTransform> ObjectName_TransformMap;
-    TMap<FString, FTransform> BoneName_TransformMap;
-    FString Subjectname;
-    PoseFrame(TArray<FString> PoseFrameArray);
+    // Objects of O_ entries, named without the prefix
+    TArray<FName> ObjectNames;
+    TArray<FTransform> ObjectTransforms;
+    TArray<FPoseFrameStamp> ObjectStamps;
+    // Armatures of the datagram in the order they were sent, only the first NumSubjects are valid
+    TArray<FPoseFrameSubject> Subjects;
+    int32 NumSubjects = 0;
+    // Parent bone indices announced by H_ entries, -1 for roots
+    TMap<FName, TArray<int32>> BoneParents;
+    // Pose of every armature seen so far, kept across datagrams
+    TMap<FName, FPoseFrameSubjectState> SubjectStates;
+
+    /// <summary>
+    /// Parses the datagram in place in a single pass, without building intermediate strings
+    ///		O_Cube=(1.0,2.0,3.0,4.0,5.0,6.0,7.0)||
+    ///		A_Skeleton1=Bone1:(8.0,9.0,10.0,11.0,12.0,13.0,14.0)|Bone2:(15.0,16.0,17.0,18.0,19.0,20.0,21.0)||
+    ///		A_Skeleton2=Bone1:(8.0,9.0,10.0,11.0,12.0,13.0,14.0)||
+    ///		H_Skeleton1=-1,0||
+    ///		S_=42,1234567||A_Skeleton3=Bone1:(8.0,9.0,10.0,11.0,12.0,13.0,14.0)||
+    ///		P_Skeleton1=Bone2:(15.0,16.0,17.0,18.0,19.0,20.0,21.0)||
+    /// A P_ entry only lists the bones that moved, the subject is output with every bone of its last A_ entry updated by
+    /// them. Partial updates of armatures without a full pose yet are dropped.
+    /// </summary>
+    bool ParseText(const uint8* Data, int32 Num);
+
+    /// <summary>
+    /// Same as above, stamped subjects are only parsed if AcceptStamp returns true for them
+    /// </summary>
+    bool ParseText(const uint8* Data, int32 Num, TFunctionRef<bool(FName, const FPoseFrameStamp&)> AcceptStamp);
+
+    /// <summary>
+    /// Changes string form of transform to FTransform object (x,y,z,qx,qy,qz,qw) -> FTransform
+    /// </summary>
+    static bool ConvertToTransform(const ANSICHAR* Begin, const ANSICHAR* End, FTransform& OutTransform);
 
     /// <summary>
-    /// Changes string form of transform to FTransform object (x,y,z,qw,qx,qy,qz,sx,sy,sz) -> FTransform
+    /// Parses a decimal number with the same result as FCString::Atof, reading it straight out of the datagram
     /// </summary>
-    FTransform ConvertToTransform(FString transformText);
+    static float ParseFloat(const ANSICHAR* Begin, const ANSICHAR* End);
 };
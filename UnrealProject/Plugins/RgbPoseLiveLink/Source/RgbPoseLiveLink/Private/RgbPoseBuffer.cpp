@@ -0,0 +1,285 @@
+﻿#include "RgbPoseBuffer.h"
+
+#include "Math/Float16.h"
+#include "Math/VectorRegister.h"
+
+namespace RgbPoseBufferKernels
+{
+	// Bones of a packed pose dequantised at a time, keeps the scratch buffer on the stack
+	static const int32 PackedBlockSize = 64;
+
+	// The three smaller components of a unit quaternion lie within +-1/sqrt(2)
+	static const float SmallestThreeRange = 0.707106781f;
+	static const float SmallestThreeStep = 2.0f * SmallestThreeRange / 1023.0f;
+
+	// Where the three smaller components go, by index of the largest one
+	static const int32 SmallestThreeOrder[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+
+	static void PlaceSmallestThree(float* const* OutQuat, int32 Bone, uint32 Largest, float A, float B, float C, float D)
+	{
+		const int32* Order = SmallestThreeOrder[Largest];
+		OutQuat[Order[0]][Bone] = A;
+		OutQuat[Order[1]][Bone] = B;
+		OutQuat[Order[2]][Bone] = C;
+		OutQuat[Largest][Bone] = D;
+	}
+
+	/** Splits Count x,y,z triples into three arrays, four triples per iteration */
+	static void DeinterleaveTriples(const float* Source, int32 Count, float* OutX, float* OutY, float* OutZ)
+	{
+		int32 Index = 0;
+		for (; Index + 4 <= Count; Index += 4)
+		{
+			// x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+			const VectorRegister V0 = VectorLoad(Source + Index * 3);
+			const VectorRegister V1 = VectorLoad(Source + Index * 3 + 4);
+			const VectorRegister V2 = VectorLoad(Source + Index * 3 + 8);
+			VectorStore(VectorShuffle(V0, VectorShuffle(V1, V2, 2, 2, 1, 1), 0, 3, 0, 2), OutX + Index);
+			VectorStore(VectorShuffle(VectorShuffle(V0, V1, 1, 1, 0, 0), VectorShuffle(V1, V2, 3, 3, 2, 2), 0, 2, 0, 2), OutY + Index);
+			VectorStore(VectorShuffle(VectorShuffle(V0, V1, 2, 2, 1, 1), V2, 0, 2, 0, 3), OutZ + Index);
+		}
+		for (; Index < Count; Index++)
+		{
+			OutX[Index] = Source[Index * 3];
+			OutY[Index] = Source[Index * 3 + 1];
+			OutZ[Index] = Source[Index * 3 + 2];
+		}
+	}
+
+	/** Splits Count x,y,z,w quadruples into four arrays, a 4x4 transpose per iteration */
+	static void DeinterleaveQuadruples(const float* Source, int32 Count, float* const* OutQuat)
+	{
+		int32 Index = 0;
+		for (; Index + 4 <= Count; Index += 4)
+		{
+			const VectorRegister R0 = VectorLoad(Source + Index * 4);
+			const VectorRegister R1 = VectorLoad(Source + Index * 4 + 4);
+			const VectorRegister R2 = VectorLoad(Source + Index * 4 + 8);
+			const VectorRegister R3 = VectorLoad(Source + Index * 4 + 12);
+			const VectorRegister T0 = VectorShuffle(R0, R1, 0, 1, 0, 1);
+			const VectorRegister T1 = VectorShuffle(R0, R1, 2, 3, 2, 3);
+			const VectorRegister T2 = VectorShuffle(R2, R3, 0, 1, 0, 1);
+			const VectorRegister T3 = VectorShuffle(R2, R3, 2, 3, 2, 3);
+			VectorStore(VectorShuffle(T0, T2, 0, 2, 0, 2), OutQuat[0] + Index);
+			VectorStore(VectorShuffle(T0, T2, 1, 3, 1, 3), OutQuat[1] + Index);
+			VectorStore(VectorShuffle(T1, T3, 0, 2, 0, 2), OutQuat[2] + Index);
+			VectorStore(VectorShuffle(T1, T3, 1, 3, 1, 3), OutQuat[3] + Index);
+		}
+		for (; Index < Count; Index++)
+		{
+			for (int32 Component = 0; Component < 4; Component++)
+			{
+				OutQuat[Component][Index] = Source[Index * 4 + Component];
+			}
+		}
+	}
+
+	/** Converts Count int16 to floats times Scale, eight per iteration */
+	static void DequantiseInt16(const uint8* Source, int32 Count, float Scale, float* OutValues)
+	{
+		const VectorRegister VectorScale = VectorSetFloat1(Scale);
+		int32 Index = 0;
+		for (; Index + 8 <= Count; Index += 8)
+		{
+			// Each 32-bit lane holds two values, the low one is sign extended by shifting it up and back down
+			const VectorRegisterInt Pairs = VectorIntLoad(Source + Index * sizeof(int16));
+			const VectorRegister Even = VectorMultiply(VectorIntToFloat(VectorShiftRightImmArithmetic(VectorShiftLeftImm(Pairs, 16), 16)), VectorScale);
+			const VectorRegister Odd = VectorMultiply(VectorIntToFloat(VectorShiftRightImmArithmetic(Pairs, 16)), VectorScale);
+			// Even holds 0,2,4,6 and Odd 1,3,5,7, interleaved back in order
+			VectorStore(VectorSwizzle(VectorShuffle(Even, Odd, 0, 1, 0, 1), 0, 2, 1, 3), OutValues + Index);
+			VectorStore(VectorSwizzle(VectorShuffle(Even, Odd, 2, 3, 2, 3), 0, 2, 1, 3), OutValues + Index + 4);
+		}
+		for (; Index < Count; Index++)
+		{
+			int16 Value;
+			FMemory::Memcpy(&Value, Source + Index * sizeof(int16), sizeof(int16));
+			OutValues[Index] = Value * Scale;
+		}
+	}
+
+	/** Unpacks Count smallest-three rotations, four per iteration */
+	static void DecodeSmallestThree(const uint8* Source, int32 Count, float* const* OutQuat)
+	{
+		const VectorRegisterInt TenBits = MakeVectorRegisterInt(0x3FF, 0x3FF, 0x3FF, 0x3FF);
+		const VectorRegister Step = VectorSetFloat1(SmallestThreeStep);
+		const VectorRegister Offset = VectorSetFloat1(-SmallestThreeRange);
+		const VectorRegister MinSquare = VectorSetFloat1(SMALL_NUMBER);
+		int32 Index = 0;
+		for (; Index + 4 <= Count; Index += 4)
+		{
+			const VectorRegisterInt Packed = VectorIntLoad(Source + Index * sizeof(uint32));
+			const VectorRegister A = VectorMultiplyAdd(VectorIntToFloat(VectorIntAnd(VectorShiftRightImmLogical(Packed, 20), TenBits)), Step, Offset);
+			const VectorRegister B = VectorMultiplyAdd(VectorIntToFloat(VectorIntAnd(VectorShiftRightImmLogical(Packed, 10), TenBits)), Step, Offset);
+			const VectorRegister C = VectorMultiplyAdd(VectorIntToFloat(VectorIntAnd(Packed, TenBits)), Step, Offset);
+			const VectorRegister Square = VectorMax(VectorSubtract(GlobalVectorConstants::FloatOne, VectorMultiplyAdd(A, A, VectorMultiplyAdd(B, B, VectorMultiply(C, C)))), MinSquare);
+			const VectorRegister D = VectorMultiply(Square, VectorReciprocalSqrtAccurate(Square));
+
+			// Lanes have their largest component in different places, only the final placement is per bone
+			float Lanes[4][4];
+			VectorStore(A, Lanes[0]);
+			VectorStore(B, Lanes[1]);
+			VectorStore(C, Lanes[2]);
+			VectorStore(D, Lanes[3]);
+			for (int32 Lane = 0; Lane < 4; Lane++)
+			{
+				uint32 Word;
+				FMemory::Memcpy(&Word, Source + (Index + Lane) * sizeof(uint32), sizeof(uint32));
+				PlaceSmallestThree(OutQuat, Index + Lane, Word >> 30, Lanes[0][Lane], Lanes[1][Lane], Lanes[2][Lane], Lanes[3][Lane]);
+			}
+		}
+		for (; Index < Count; Index++)
+		{
+			uint32 Word;
+			FMemory::Memcpy(&Word, Source + Index * sizeof(uint32), sizeof(uint32));
+			const float A = ((Word >> 20) & 0x3FF) * SmallestThreeStep - SmallestThreeRange;
+			const float B = ((Word >> 10) & 0x3FF) * SmallestThreeStep - SmallestThreeRange;
+			const float C = (Word & 0x3FF) * SmallestThreeStep - SmallestThreeRange;
+			const float D = FMath::Sqrt(FMath::Max(1.0f - (A * A + B * B + C * C), 0.0f));
+			PlaceSmallestThree(OutQuat, Index, Word >> 30, A, B, C, D);
+		}
+	}
+
+	static void MultiplyArray(float* Values, int32 PaddedCount, float Factor)
+	{
+		const VectorRegister VectorFactor = VectorSetFloat1(Factor);
+		for (int32 Index = 0; Index < PaddedCount; Index += 4)
+		{
+			VectorStoreAligned(VectorMultiply(VectorLoadAligned(Values + Index), VectorFactor), Values + Index);
+		}
+	}
+}
+
+void FRgbPoseBuffer::SetNum(int32 InNumBones)
+{
+	NumBones = InNumBones;
+	const int32 PaddedNum = Align(NumBones, 4);
+	for (int32 Component = 0; Component < NumComponents; Component++)
+	{
+		Components[Component].SetNumUninitialized(PaddedNum, false);
+		for (int32 Bone = NumBones; Bone < PaddedNum; Bone++)
+		{
+			Components[Component][Bone] = Component == QW ? 1.0f : 0.0f;
+		}
+	}
+}
+
+void FRgbPoseBuffer::UnpackFloats(const uint8* Positions, const uint8* Rotations)
+{
+	using namespace RgbPoseBufferKernels;
+
+	float* const Quat[4] = { GetComponent(QX), GetComponent(QY), GetComponent(QZ), GetComponent(QW) };
+	DeinterleaveTriples(reinterpret_cast<const float*>(Positions), NumBones, GetComponent(X), GetComponent(Y), GetComponent(Z));
+	DeinterleaveQuadruples(reinterpret_cast<const float*>(Rotations), NumBones, Quat);
+}
+
+void FRgbPoseBuffer::UnpackHalfs(const uint8* Positions, const uint8* Rotations)
+{
+	for (int32 Component = X; Component <= QW; Component++)
+	{
+		const bool bPosition = Component <= Z;
+		const int32 Stride = bPosition ? 3 : 4;
+		const uint8* Source = (bPosition ? Positions : Rotations) + (bPosition ? Component : Component - QX) * sizeof(uint16);
+		float* Values = GetComponent(Component);
+		for (int32 Bone = 0; Bone < NumBones; Bone++)
+		{
+			FFloat16 Value;
+			FMemory::Memcpy(&Value.Encoded, Source + Bone * Stride * sizeof(uint16), sizeof(uint16));
+			Values[Bone] = Value.GetFloat();
+		}
+	}
+}
+
+void FRgbPoseBuffer::UnpackPacked(const uint8* Positions, float PositionScale, const uint8* Rotations)
+{
+	using namespace RgbPoseBufferKernels;
+
+	float BlockPositions[PackedBlockSize * 3];
+	for (int32 FirstBone = 0; FirstBone < NumBones; FirstBone += PackedBlockSize)
+	{
+		const int32 NumBlockBones = FMath::Min(PackedBlockSize, NumBones - FirstBone);
+		DequantiseInt16(Positions + FirstBone * 3 * sizeof(int16), NumBlockBones * 3, PositionScale, BlockPositions);
+		DeinterleaveTriples(BlockPositions, NumBlockBones, GetComponent(X) + FirstBone, GetComponent(Y) + FirstBone, GetComponent(Z) + FirstBone);
+	}
+
+	float* const Quat[4] = { GetComponent(QX), GetComponent(QY), GetComponent(QZ), GetComponent(QW) };
+	DecodeSmallestThree(Rotations, NumBones, Quat);
+}
+
+void FRgbPoseBuffer::ConvertSpace(const FRgbPoseSpaceConversion& Conversion)
+{
+	using namespace RgbPoseBufferKernels;
+
+	///		REORDERING AXES ONLY MOVES THE ARRAYS, POSITIONS AND ROTATION AXES FOLLOW THE SAME ORDER
+	TArray<float, TAlignedHeapAllocator<16>> Reordered[6];
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		Reordered[Axis] = MoveTemp(Components[X + Conversion.AxisOrder[Axis]]);
+		Reordered[3 + Axis] = MoveTemp(Components[QX + Conversion.AxisOrder[Axis]]);
+	}
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		Components[X + Axis] = MoveTemp(Reordered[Axis]);
+		Components[QX + Axis] = MoveTemp(Reordered[3 + Axis]);
+	}
+
+	///		SIGNS AND UNIT SCALE ARE ONE MULTIPLY PER COMPONENT
+	const int32 PaddedNum = Align(NumBones, 4);
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const float Factor = Conversion.PositionSigns[Axis] * Conversion.PositionScale;
+		if (Factor != 1.0f)
+		{
+			MultiplyArray(GetComponent(X + Axis), PaddedNum, Factor);
+		}
+	}
+	for (int32 Component = 0; Component < 4; Component++)
+	{
+		if (Conversion.RotationSigns[Component] != 1.0f)
+		{
+			MultiplyArray(GetComponent(QX + Component), PaddedNum, Conversion.RotationSigns[Component]);
+		}
+	}
+}
+
+void FRgbPoseBuffer::NormalizeRotations()
+{
+	const VectorRegister MinSquare = VectorSetFloat1(SMALL_NUMBER);
+	float* QuatX = GetComponent(QX);
+	float* QuatY = GetComponent(QY);
+	float* QuatZ = GetComponent(QZ);
+	float* QuatW = GetComponent(QW);
+	const int32 PaddedNum = Align(NumBones, 4);
+	for (int32 Index = 0; Index < PaddedNum; Index += 4)
+	{
+		const VectorRegister VX = VectorLoadAligned(QuatX + Index);
+		const VectorRegister VY = VectorLoadAligned(QuatY + Index);
+		const VectorRegister VZ = VectorLoadAligned(QuatZ + Index);
+		const VectorRegister VW = VectorLoadAligned(QuatW + Index);
+		const VectorRegister Square = VectorMultiplyAdd(VX, VX, VectorMultiplyAdd(VY, VY, VectorMultiplyAdd(VZ, VZ, VectorMultiply(VW, VW))));
+		const VectorRegister Valid = VectorCompareGT(Square, MinSquare);
+		const VectorRegister InvLength = VectorReciprocalSqrtAccurate(VectorMax(Square, MinSquare));
+		VectorStoreAligned(VectorSelect(Valid, VectorMultiply(VX, InvLength), GlobalVectorConstants::FloatZero), QuatX + Index);
+		VectorStoreAligned(VectorSelect(Valid, VectorMultiply(VY, InvLength), GlobalVectorConstants::FloatZero), QuatY + Index);
+		VectorStoreAligned(VectorSelect(Valid, VectorMultiply(VZ, InvLength), GlobalVectorConstants::FloatZero), QuatZ + Index);
+		VectorStoreAligned(VectorSelect(Valid, VectorMultiply(VW, InvLength), GlobalVectorConstants::FloatOne), QuatW + Index);
+	}
+}
+
+void FRgbPoseBuffer::ToTransforms(TArray<FTransform>& OutTransforms) const
+{
+	const float* PositionX = GetComponent(X);
+	const float* PositionY = GetComponent(Y);
+	const float* PositionZ = GetComponent(Z);
+	const float* QuatX = GetComponent(QX);
+	const float* QuatY = GetComponent(QY);
+	const float* QuatZ = GetComponent(QZ);
+	const float* QuatW = GetComponent(QW);
+
+	OutTransforms.Reset(NumBones);
+	OutTransforms.AddUninitialized(NumBones);
+	FTransform* Transforms = OutTransforms.GetData();
+	for (int32 Bone = 0; Bone < NumBones; Bone++)
+	{
+		new (Transforms + Bone) FTransform(FQuat(QuatX[Bone], QuatY[Bone], QuatZ[Bone], QuatW[Bone]), FVector(PositionX[Bone], PositionY[Bone], PositionZ[Bone]));
+	}
+}
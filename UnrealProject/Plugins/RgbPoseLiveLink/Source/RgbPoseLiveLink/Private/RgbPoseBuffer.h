@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * How a pose is taken from the sender's space into Unreal's: output axis N is input axis AxisOrder[N] times
+ * PositionSigns[N], positions are then scaled and each rotation component multiplied by its sign.
+ */
+struct FRgbPoseSpaceConversion
+{
+	int32 AxisOrder[3] = { 0, 1, 2 };
+	float PositionSigns[3] = { 1.0f, 1.0f, 1.0f };
+	float PositionScale = 1.0f;
+	// x, y, z, w, applied after the axes are reordered
+	float RotationSigns[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+};
+
+/**
+ * One pose as structure-of-arrays, a float array per component, so every kernel works on four bones per vector
+ * operation. Arrays are padded to a multiple of four with zero positions and identity rotations. Poses stay in this
+ * form from the wire until ToTransforms builds the FTransforms LiveLink takes, in a single pass.
+ */
+class FRgbPoseBuffer
+{
+public:
+	enum EComponent
+	{
+		X,
+		Y,
+		Z,
+		QX,
+		QY,
+		QZ,
+		QW,
+		NumComponents
+	};
+
+	/** Resizes every component array, keeping their capacity */
+	void SetNum(int32 InNumBones);
+	int32 Num() const { return NumBones; }
+
+	float* GetComponent(int32 Component) { return Components[Component].GetData(); }
+	const float* GetComponent(int32 Component) const { return Components[Component].GetData(); }
+
+	/** Splits Num() x,y,z positions and Num() x,y,z,w rotations, stored as float32 */
+	void UnpackFloats(const uint8* Positions, const uint8* Rotations);
+
+	/** Same as UnpackFloats for float16 components */
+	void UnpackHalfs(const uint8* Positions, const uint8* Rotations);
+
+	/** Unpacks Num() int16 x,y,z positions in PositionScale steps and Num() smallest-three rotations */
+	void UnpackPacked(const uint8* Positions, float PositionScale, const uint8* Rotations);
+
+	/** Reorders axes, flips signs and scales positions in one pass */
+	void ConvertSpace(const FRgbPoseSpaceConversion& Conversion);
+
+	/** Scales every rotation to unit length, degenerate ones become the identity */
+	void NormalizeRotations();
+
+	/** Builds the transforms handed to LiveLink */
+	void ToTransforms(TArray<FTransform>& OutTransforms) const;
+
+private:
+	int32 NumBones = 0;
+	TArray<float, TAlignedHeapAllocator<16>> Components[NumComponents];
+};
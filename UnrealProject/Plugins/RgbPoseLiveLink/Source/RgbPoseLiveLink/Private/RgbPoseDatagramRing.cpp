@@ -0,0 +1,112 @@
+﻿#include "RgbPoseDatagramRing.h"
+
+FRgbPoseDatagramRing::FRgbPoseDatagramRing()
+	: NumSlots(0)
+	, SlotSize(0)
+	, Head(0)
+	, Tail(0)
+	, WriteSlot(INDEX_NONE)
+	, ReadSlot(INDEX_NONE)
+{
+}
+
+void FRgbPoseDatagramRing::Initialize(int32 InCapacity, int32 InSlotSize)
+{
+	NumSlots = FMath::Max(InCapacity, 1) + 1;
+	SlotSize = FMath::Max(InSlotSize, 1);
+	Storage.SetNumUninitialized(NumSlots * SlotSize);
+	SlotSizes.SetNumZeroed(NumSlots);
+	SlotReceiveTimes.SetNumZeroed(NumSlots);
+	SlotStates = MakeUnique<std::atomic<uint8>[]>(NumSlots);
+	for (int32 Slot = 0; Slot < NumSlots; Slot++)
+	{
+		SlotStates[Slot].store(Free, std::memory_order_relaxed);
+	}
+	Head.store(0, std::memory_order_relaxed);
+	Tail.store(0, std::memory_order_relaxed);
+	WriteSlot = INDEX_NONE;
+	ReadSlot = INDEX_NONE;
+}
+
+uint8* FRgbPoseDatagramRing::BeginWrite()
+{
+	const uint64 Capacity = NumSlots - 1;
+	const uint64 WriteIndex = Head.load(std::memory_order_relaxed);
+	uint64 ReadIndex = Tail.load(std::memory_order_acquire);
+	while (WriteIndex - ReadIndex >= Capacity)
+	{
+		// Full, evict the oldest datagram unless the consumer takes it first
+		if (Tail.compare_exchange_weak(ReadIndex, ReadIndex + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			Overflows.Increment();
+			Dropped.Increment();
+			break;
+		}
+	}
+
+	// After evicting, the slot may still be the one the consumer is reading
+	const int32 Slot = (int32)(WriteIndex % NumSlots);
+	uint8 State = SlotStates[Slot].load(std::memory_order_acquire);
+	if (State == Reading || !SlotStates[Slot].compare_exchange_strong(State, Writing, std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+	WriteSlot = Slot;
+	return Storage.GetData() + (int64)Slot * SlotSize;
+}
+
+void FRgbPoseDatagramRing::CommitWrite(int32 Size, double ReceiveTime)
+{
+	check(WriteSlot != INDEX_NONE);
+	SlotSizes[WriteSlot] = Size;
+	SlotReceiveTimes[WriteSlot] = ReceiveTime;
+	SlotStates[WriteSlot].store(Ready, std::memory_order_release);
+	Head.store(Head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	WriteSlot = INDEX_NONE;
+}
+
+void FRgbPoseDatagramRing::CancelWrite(bool bDropped)
+{
+	check(WriteSlot != INDEX_NONE);
+	SlotStates[WriteSlot].store(Free, std::memory_order_release);
+	WriteSlot = INDEX_NONE;
+	if (bDropped)
+	{
+		Dropped.Increment();
+	}
+}
+
+const uint8* FRgbPoseDatagramRing::BeginRead(int32& OutSize, double& OutReceiveTime)
+{
+	check(ReadSlot == INDEX_NONE);
+	uint64 ReadIndex = Tail.load(std::memory_order_acquire);
+	while (ReadIndex != Head.load(std::memory_order_acquire))
+	{
+		// Claim the slot before the index, so the producer cannot start rewriting it underneath us
+		const int32 Slot = (int32)(ReadIndex % NumSlots);
+		uint8 State = Ready;
+		if (!SlotStates[Slot].compare_exchange_strong(State, Reading, std::memory_order_acquire))
+		{
+			// The producer evicted this datagram and is writing a newer one into the slot
+			ReadIndex = Tail.load(std::memory_order_acquire);
+			continue;
+		}
+		if (Tail.compare_exchange_strong(ReadIndex, ReadIndex + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			ReadSlot = Slot;
+			OutSize = SlotSizes[Slot];
+			OutReceiveTime = SlotReceiveTimes[Slot];
+			return Storage.GetData() + (int64)Slot * SlotSize;
+		}
+		// Evicted between the two steps, the slot holds a newer datagram that stays queued
+		SlotStates[Slot].store(Ready, std::memory_order_release);
+	}
+	return nullptr;
+}
+
+void FRgbPoseDatagramRing::EndRead()
+{
+	check(ReadSlot != INDEX_NONE);
+	SlotStates[ReadSlot].store(Free, std::memory_order_release);
+	ReadSlot = INDEX_NONE;
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Templates/UniquePtr.h"
+
+#include <atomic>
+
+/**
+ * Fixed set of datagram slots shared by one producer (the UDP thread) and one consumer.
+ *
+ * All memory is allocated by Initialize, the producer receives straight into a slot and the consumer reads it in place,
+ * so nothing is allocated or copied per datagram. When the ring is full the producer evicts the oldest datagram.
+ * The slot the consumer is reading is never reused until EndRead, which is why there is one more slot than Capacity.
+ */
+class FRgbPoseDatagramRing
+{
+public:
+	FRgbPoseDatagramRing();
+
+	/** Allocates the slots, must be called before the producer and consumer start */
+	void Initialize(int32 InCapacity, int32 InSlotSize);
+
+	int32 GetCapacity() const { return NumSlots - 1; }
+	int32 GetSlotSize() const { return SlotSize; }
+
+	/** Producer: returns a slot of GetSlotSize() bytes to receive into, or nullptr while the consumer still holds it */
+	uint8* BeginWrite();
+
+	/** Producer: publishes the slot returned by BeginWrite along with the time it was received */
+	void CommitWrite(int32 Size, double ReceiveTime);
+
+	/** Producer: gives the slot back unpublished, counting it as a dropped datagram if bDropped is set */
+	void CancelWrite(bool bDropped);
+
+	/** Consumer: returns the oldest datagram and the time it was received, or nullptr when the ring is empty */
+	const uint8* BeginRead(int32& OutSize, double& OutReceiveTime);
+
+	/** Consumer: releases the datagram returned by BeginRead */
+	void EndRead();
+
+	// Times a datagram arrived while the ring was full
+	int32 GetNumOverflows() const { return Overflows.GetValue(); }
+
+	// Datagrams lost, evicted by newer ones or too large for a slot
+	int32 GetNumDropped() const { return Dropped.GetValue(); }
+
+private:
+	enum ESlotState : uint8
+	{
+		Free,
+		Writing,
+		Ready,
+		Reading,
+	};
+
+	int32 NumSlots;
+	int32 SlotSize;
+	TArray<uint8> Storage;
+	TArray<int32> SlotSizes;
+	TArray<double> SlotReceiveTimes;
+	TUniquePtr<std::atomic<uint8>[]> SlotStates;
+
+	// Index of the next datagram to write, only advanced by the producer
+	std::atomic<uint64> Head;
+	uint8 HeadPadding[PLATFORM_CACHE_LINE_SIZE];
+
+	// Index of the oldest unread datagram, advanced by the consumer and by the producer when it evicts
+	std::atomic<uint64> Tail;
+	uint8 TailPadding[PLATFORM_CACHE_LINE_SIZE];
+
+	// Slot held between BeginWrite/CommitWrite and between BeginRead/EndRead
+	int32 WriteSlot;
+	int32 ReadSlot;
+
+	FThreadSafeCounter Overflows;
+	FThreadSafeCounter Dropped;
+};
@@ -0,0 +1,95 @@
+﻿#include "RgbPoseFragmentAssembler.h"
+
+namespace RgbPoseFragmentAssembly
+{
+	// Bounds what a broken or hostile sender can make the receiver allocate
+	static const uint32 MaxMessageSize = 16 * 1024 * 1024;
+	static const int32 MaxPendingMessages = 16;
+}
+
+bool FRgbPoseFragmentAssembler::Add(const FRgbPoseFragmentHeader& Fragment, const uint8* Chunk, int32 ChunkSize, double ReceiveTime, TArray<uint8>& OutMessage)
+{
+	using namespace RgbPoseFragmentAssembly;
+
+	EvictStale(ReceiveTime);
+	if (Fragment.MessageSize > MaxMessageSize)
+	{
+		return false;
+	}
+
+	///		A MESSAGE ID SEEN WITH A DIFFERENT LAYOUT BELONGS TO A RESTARTED SENDER, WHAT WAS ASSEMBLED SO FAR IS STALE
+	FPendingMessage* Message = Pending.Find(Fragment.MessageId);
+	if (Message != nullptr && (Message->Data.Num() != (int32)Fragment.MessageSize || Message->ChunkCount != Fragment.ChunkCount))
+	{
+		Pending.Remove(Fragment.MessageId);
+		Evicted.Increment();
+		Message = nullptr;
+	}
+	if (Message == nullptr)
+	{
+		if (Pending.Num() >= MaxPendingMessages)
+		{
+			EvictOldest();
+		}
+		Message = &Pending.Add(Fragment.MessageId);
+		Message->Data.SetNumUninitialized(Fragment.MessageSize);
+		Message->ReceivedChunks.Init(false, Fragment.ChunkCount);
+		Message->ChunkCount = Fragment.ChunkCount;
+		Message->FirstReceiveTime = ReceiveTime;
+	}
+
+	if (Message->ReceivedChunks[Fragment.ChunkIndex])
+	{
+		return false;
+	}
+	FMemory::Memcpy(Message->Data.GetData() + Fragment.ChunkOffset, Chunk, ChunkSize);
+	Message->ReceivedChunks[Fragment.ChunkIndex] = true;
+	Message->NumReceivedChunks++;
+	Message->NumReceivedBytes += ChunkSize;
+	if (Message->NumReceivedChunks < Message->ChunkCount)
+	{
+		return false;
+	}
+
+	///		CHUNKS THAT DO NOT ADD UP TO THE MESSAGE SIZE WOULD LEAVE PART OF IT UNWRITTEN
+	const bool bComplete = Message->NumReceivedBytes == Message->Data.Num();
+	if (bComplete)
+	{
+		OutMessage = MoveTemp(Message->Data);
+		Reassembled.Increment();
+	}
+	else
+	{
+		Evicted.Increment();
+	}
+	Pending.Remove(Fragment.MessageId);
+	return bComplete;
+}
+
+void FRgbPoseFragmentAssembler::EvictStale(double Now)
+{
+	for (auto It = Pending.CreateIterator(); It; ++It)
+	{
+		if (Now - It.Value().FirstReceiveTime > TimeoutSeconds)
+		{
+			It.RemoveCurrent();
+			Evicted.Increment();
+		}
+	}
+}
+
+void FRgbPoseFragmentAssembler::EvictOldest()
+{
+	uint32 OldestId = 0;
+	double OldestTime = TNumericLimits<double>::Max();
+	for (const TPair<uint32, FPendingMessage>& Pair : Pending)
+	{
+		if (Pair.Value.FirstReceiveTime < OldestTime)
+		{
+			OldestId = Pair.Key;
+			OldestTime = Pair.Value.FirstReceiveTime;
+		}
+	}
+	Pending.Remove(OldestId);
+	Evicted.Increment();
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "RgbPoseProtocol.h"
+
+/**
+ * Puts messages the sender split into fragment packets back together. Chunks may arrive in any order, a message is handed
+ * out once every chunk is in and thrown away when it is still incomplete after the timeout, or when too many others are
+ * being assembled at the same time.
+ */
+class FRgbPoseFragmentAssembler
+{
+public:
+	void SetTimeout(double InTimeoutSeconds) { TimeoutSeconds = InTimeoutSeconds; }
+
+	/** Stores the chunk. True when it was the last one missing, OutMessage then holds the whole message */
+	bool Add(const FRgbPoseFragmentHeader& Fragment, const uint8* Chunk, int32 ChunkSize, double ReceiveTime, TArray<uint8>& OutMessage);
+
+	// Messages put back together, and those evicted with chunks still missing
+	int32 GetNumReassembled() const { return Reassembled.GetValue(); }
+	int32 GetNumEvicted() const { return Evicted.GetValue(); }
+
+private:
+	struct FPendingMessage
+	{
+		TArray<uint8> Data;
+		TBitArray<> ReceivedChunks;
+		int32 NumReceivedChunks = 0;
+		int64 NumReceivedBytes = 0;
+		uint16 ChunkCount = 0;
+		double FirstReceiveTime = 0.0;
+	};
+
+	void EvictStale(double Now);
+	void EvictOldest();
+
+	TMap<uint32, FPendingMessage> Pending;
+	double TimeoutSeconds = 0.25;
+
+	FThreadSafeCounter Reassembled;
+	FThreadSafeCounter Evicted;
+};
@@ -0,0 +1,139 @@
+﻿#include "RgbPoseFrameCoalescer.h"
+
+#include "Misc/Crc.h"
+#include "RgbPoseProtocol.h"
+
+bool FRgbPoseFrameCoalescer::PeekKey(const uint8* Data, int32 Num, uint32& OutKey, uint32& OutFrameNumber, bool& bOutHasFrameNumber)
+{
+	if (RgbPoseProtocol::IsBinaryPacket(Data, Num))
+	{
+		// Every packet is checked, a datagram can bundle several subjects and any one of them may be a keyframe
+		FRgbPosePacketHeader Header;
+		const uint8* Payload = nullptr;
+		bool bFirst = true;
+		while (RgbPoseProtocol::ReadHeader(Data, Num, Header, Payload))
+		{
+			// Keyframes are what later deltas are rebuilt from, they are never skipped, nor are skeletons and fragments
+			const ERgbPosePacketType PacketType = (ERgbPosePacketType)Header.PacketType;
+			const bool bKeyframe = (Header.Flags & ERgbPosePacketFlags::Keyframe) != 0;
+			if (!(PacketType == ERgbPosePacketType::Pose && !bKeyframe) && PacketType != ERgbPosePacketType::PoseDelta)
+			{
+				return false;
+			}
+			// A datagram of several subjects would be replaced by a newer one of its first subject alone
+			if (!bFirst && Header.SubjectId != OutKey)
+			{
+				return false;
+			}
+			if (bFirst)
+			{
+				OutKey = Header.SubjectId;
+				OutFrameNumber = Header.FrameNumber;
+				bFirst = false;
+			}
+			const int32 PacketSize = Header.HeaderSize + Header.PayloadSize;
+			Data += PacketSize;
+			Num -= PacketSize;
+		}
+		bOutHasFrameNumber = !bFirst;
+		return !bFirst;
+	}
+
+	// The sender stamp carries the frame number, the subject is the entry after it
+	bOutHasFrameNumber = false;
+	if (Num >= 3 && Data[0] == 'S' && Data[1] == '_' && Data[2] == '=')
+	{
+		int32 Cursor = 3;
+		OutFrameNumber = 0;
+		for (; Cursor < Num && Data[Cursor] >= '0' && Data[Cursor] <= '9'; Cursor++)
+		{
+			OutFrameNumber = OutFrameNumber * 10 + (Data[Cursor] - '0');
+		}
+		while (Cursor + 1 < Num && (Data[Cursor] != '|' || Data[Cursor + 1] != '|'))
+		{
+			Cursor++;
+		}
+		bOutHasFrameNumber = true;
+		Data += Cursor + 2;
+		Num -= Cursor + 2;
+	}
+
+	// Only poses are coalesced, a datagram opening with a hierarchy entry is handled in order
+	if (Num < 2 || Data[1] != '_' || (Data[0] != 'A' && Data[0] != 'O'))
+	{
+		return false;
+	}
+	int32 NameLength = 0;
+	while (NameLength < Num && Data[NameLength] != '=')
+	{
+		NameLength++;
+	}
+	// Senders leave out subjects that did not move, so a datagram of several subjects is not always followed by one with
+	// the same subjects. Only datagrams holding a single entry are skipped, anything after its "||" is handled in order
+	for (int32 Cursor = NameLength; Cursor + 1 < Num; Cursor++)
+	{
+		if (Data[Cursor] == '|' && Data[Cursor + 1] == '|')
+		{
+			if (Cursor + 2 < Num)
+			{
+				return false;
+			}
+			break;
+		}
+	}
+	OutKey = FCrc::MemCrc32(Data, NameLength);
+	return true;
+}
+
+bool FRgbPoseFrameCoalescer::Add(const uint8* Data, int32 Num, double ReceiveTime)
+{
+	uint32 Key = 0;
+	uint32 FrameNumber = 0;
+	bool bHasFrameNumber = false;
+	if (!PeekKey(Data, Num, Key, FrameNumber, bHasFrameNumber))
+	{
+		return false;
+	}
+
+	FPendingDatagram& Datagram = Pending.FindOrAdd(Key);
+	if (Datagram.bPending)
+	{
+		StaleDropped.Increment();
+		// A late datagram older than the pending one is the stale one
+		const int32 Distance = (int32)(FrameNumber - Datagram.FrameNumber);
+		if (bHasFrameNumber && Datagram.bHasFrameNumber && Distance < 0)
+		{
+			Datagram.SupersededFrameNumbers.Add(FrameNumber);
+			return true;
+		}
+		// A repeated frame number is the same frame received twice, only one of them arrived
+		if (Datagram.bHasFrameNumber && !(bHasFrameNumber && Distance == 0))
+		{
+			Datagram.SupersededFrameNumbers.Add(Datagram.FrameNumber);
+		}
+	}
+	else
+	{
+		Datagram.bPending = true;
+		PendingOrder.Add(Key);
+	}
+
+	Datagram.Data.SetNumUninitialized(Num, false);
+	FMemory::Memcpy(Datagram.Data.GetData(), Data, Num);
+	Datagram.ReceiveTime = ReceiveTime;
+	Datagram.FrameNumber = FrameNumber;
+	Datagram.bHasFrameNumber = bHasFrameNumber;
+	return true;
+}
+
+void FRgbPoseFrameCoalescer::Flush(TFunctionRef<void(const uint8*, int32, double, const TArray<uint32>&)> Handler)
+{
+	for (uint32 Key : PendingOrder)
+	{
+		FPendingDatagram& Datagram = Pending.FindChecked(Key);
+		Datagram.bPending = false;
+		Handler(Datagram.Data.GetData(), Datagram.Data.Num(), Datagram.ReceiveTime, Datagram.SupersededFrameNumbers);
+		Datagram.SupersededFrameNumbers.Reset();
+	}
+	PendingOrder.Reset();
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Templates/Function.h"
+
+/**
+ * Keeps only the newest undecoded pose datagram per subject between two flushes.
+ *
+ * Binary pose datagrams are keyed by the subject id of their packets and ordered by frame number, only when every packet belongs to
+ * the same subject. Text datagrams are keyed by their entry after the sender stamp ("A_Armature", "O_Cube"), only when it is the
+ * datagram's single entry. Senders skip subjects that did not move, so the next datagram of a subject may not carry the others a
+ * datagram held. Everything else (skeleton packets, keyframes, fragments, datagrams of several subjects, hierarchies, partial "P_"
+ * armature updates) must not be skipped and is reported as not coalescable.
+ */
+class FRgbPoseFrameCoalescer
+{
+public:
+	/** Stores the datagram, replacing an older one of the same subject. False if it must be handled right away */
+	bool Add(const uint8* Data, int32 Num, double ReceiveTime);
+
+	/**
+	 * Hands every stored datagram, the time it was received and the frame numbers of the datagrams it superseded to Handler,
+	 * in the order their subjects first arrived
+	 */
+	void Flush(TFunctionRef<void(const uint8*, int32, double, const TArray<uint32>&)> Handler);
+
+	// Datagrams thrown away undecoded because a newer one of the same subject was received
+	int32 GetNumStaleDropped() const { return StaleDropped.GetValue(); }
+
+private:
+	struct FPendingDatagram
+	{
+		TArray<uint8> Data;
+		double ReceiveTime = 0.0;
+		uint32 FrameNumber = 0;
+		bool bHasFrameNumber = false;
+		bool bPending = false;
+		// Frames of the subject that arrived but were dropped for this one, they are not lost
+		TArray<uint32> SupersededFrameNumbers;
+	};
+
+	static bool PeekKey(const uint8* Data, int32 Num, uint32& OutKey, uint32& OutFrameNumber, bool& bOutHasFrameNumber);
+
+	// Buffers are kept per subject so their capacity is reused
+	TMap<uint32, FPendingDatagram> Pending;
+	TArray<uint32> PendingOrder;
+
+	FThreadSafeCounter StaleDropped;
+};
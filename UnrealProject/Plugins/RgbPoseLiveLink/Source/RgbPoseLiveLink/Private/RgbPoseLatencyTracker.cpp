@@ -0,0 +1,148 @@
+﻿#include "RgbPoseLatencyTracker.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogRgbPoseLatency, Log, All);
+
+namespace RgbPoseLatency
+{
+	static const double BucketMilliseconds = 0.1;
+
+	// 200 ms, slower frames are all reported as the last bucket
+	static const int32 NumBuckets = 2000;
+
+	static const TCHAR* StageNames[] = { TEXT("Receive"), TEXT("Parse"), TEXT("Push"), TEXT("Evaluate") };
+	static_assert(UE_ARRAY_COUNT(StageNames) == (int32)ERgbPoseLatencyStage::Num, "Every stage needs a name");
+
+	static void LogSummary(FName SubjectName, const TCHAR* Label, const FRgbPoseLatencySummary& Summary)
+	{
+		if (Summary.NumSamples > 0)
+		{
+			UE_LOG(LogRgbPoseLatency, Display, TEXT("%s %-8s p50 %7.2f ms  p95 %7.2f ms  p99 %7.2f ms  (%lld frames)"),
+				*SubjectName.ToString(), Label, Summary.P50, Summary.P95, Summary.P99, Summary.NumSamples);
+		}
+	}
+
+	static FAutoConsoleCommand ReportCommand(
+		TEXT("RgbPose.LatencyReport"),
+		TEXT("Logs the p50/p95/p99 latency of every RgbPose subject from the sender's timestamp to each stage, and its jitter. Latencies are relative to the fastest frame, which reads 0 ms"),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			const FRgbPoseLatencyTracker& Tracker = FRgbPoseLatencyTracker::Get();
+			UE_LOG(LogRgbPoseLatency, Display, TEXT("Latencies are relative to the fastest recent frame, which reads 0 ms, not absolute transport times"));
+			for (FName SubjectName : Tracker.GetSubjectNames())
+			{
+				for (int32 Stage = 0; Stage < (int32)ERgbPoseLatencyStage::Num; Stage++)
+				{
+					LogSummary(SubjectName, StageNames[Stage], Tracker.GetSummary(SubjectName, (ERgbPoseLatencyStage)Stage));
+				}
+				LogSummary(SubjectName, TEXT("Jitter"), Tracker.GetJitterSummary(SubjectName));
+			}
+		}));
+
+	static FAutoConsoleCommand ResetCommand(
+		TEXT("RgbPose.LatencyReset"),
+		TEXT("Clears the RgbPose latency histograms"),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FRgbPoseLatencyTracker::Get().Reset();
+		}));
+}
+
+FRgbPoseLatencyHistogram::FRgbPoseLatencyHistogram()
+	: NumSamples(0)
+{
+	Buckets.SetNumZeroed(RgbPoseLatency::NumBuckets);
+}
+
+void FRgbPoseLatencyHistogram::Add(double Milliseconds)
+{
+	const int32 Bucket = FMath::Clamp((int32)(Milliseconds / RgbPoseLatency::BucketMilliseconds), 0, RgbPoseLatency::NumBuckets - 1);
+	Buckets[Bucket]++;
+	NumSamples++;
+}
+
+double FRgbPoseLatencyHistogram::GetPercentile(double Fraction) const
+{
+	const int64 Rank = FMath::Max<int64>((int64)FMath::CeilToDouble(Fraction * NumSamples), 1);
+	int64 Count = 0;
+	for (int32 Bucket = 0; Bucket < Buckets.Num(); Bucket++)
+	{
+		Count += Buckets[Bucket];
+		if (Count >= Rank)
+		{
+			return (Bucket + 1) * RgbPoseLatency::BucketMilliseconds;
+		}
+	}
+	return 0.0;
+}
+
+FRgbPoseLatencySummary FRgbPoseLatencyHistogram::GetSummary() const
+{
+	FRgbPoseLatencySummary Summary;
+	Summary.NumSamples = NumSamples;
+	if (NumSamples > 0)
+	{
+		Summary.P50 = GetPercentile(0.50);
+		Summary.P95 = GetPercentile(0.95);
+		Summary.P99 = GetPercentile(0.99);
+	}
+	return Summary;
+}
+
+FRgbPoseLatencyTracker& FRgbPoseLatencyTracker::Get()
+{
+	static FRgbPoseLatencyTracker Instance;
+	return Instance;
+}
+
+void FRgbPoseLatencyTracker::AddSample(FName SubjectName, ERgbPoseLatencyStage Stage, double LatencySeconds)
+{
+	const double Milliseconds = FMath::Max(LatencySeconds, 0.0) * 1000.0;
+
+	FScopeLock ScopeLock(&Lock);
+	TUniquePtr<FSubjectLatency>& Subject = Subjects.FindOrAdd(SubjectName);
+	if (!Subject.IsValid())
+	{
+		Subject = MakeUnique<FSubjectLatency>();
+	}
+	Subject->Stages[(int32)Stage].Add(Milliseconds);
+
+	if (Stage == ERgbPoseLatencyStage::Receive)
+	{
+		if (Subject->LastReceiveLatency >= 0.0)
+		{
+			Subject->Jitter.Add(FMath::Abs(Milliseconds - Subject->LastReceiveLatency));
+		}
+		Subject->LastReceiveLatency = Milliseconds;
+	}
+}
+
+FRgbPoseLatencySummary FRgbPoseLatencyTracker::GetSummary(FName SubjectName, ERgbPoseLatencyStage Stage) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const TUniquePtr<FSubjectLatency>* Subject = Subjects.Find(SubjectName);
+	return Subject != nullptr ? (*Subject)->Stages[(int32)Stage].GetSummary() : FRgbPoseLatencySummary();
+}
+
+FRgbPoseLatencySummary FRgbPoseLatencyTracker::GetJitterSummary(FName SubjectName) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const TUniquePtr<FSubjectLatency>* Subject = Subjects.Find(SubjectName);
+	return Subject != nullptr ? (*Subject)->Jitter.GetSummary() : FRgbPoseLatencySummary();
+}
+
+TArray<FName> FRgbPoseLatencyTracker::GetSubjectNames() const
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FName> SubjectNames;
+	Subjects.GetKeys(SubjectNames);
+	return SubjectNames;
+}
+
+void FRgbPoseLatencyTracker::Reset()
+{
+	FScopeLock ScopeLock(&Lock);
+	Subjects.Reset();
+}
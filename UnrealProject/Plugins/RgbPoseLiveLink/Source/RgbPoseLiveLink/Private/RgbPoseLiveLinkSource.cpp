@@ -19,19 +19,45 @@
 #include "Sockets.h"
 #include "SocketSubsystem.h"
 #include "PoseFrame.h"
+#include "RgbPoseProtocol.h"
+#include "RgbPoseLatencyTracker.h"
+#include "RgbPoseLiveLinkSourceSettings.h"
 #include "Containers/UnrealString.h"
 #include "Misc/Char.h"
 #include "Containers/Array.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Stats/Stats.h"
 
 #define LOCTEXT_NAMESPACE "RgbPoseLiveLinkSource"
 
+// Per datagram logging is VeryVerbose, compiled out unless the compile time verbosity here is raised
+DEFINE_LOG_CATEGORY_STATIC(LogRgbPoseLiveLink, Log, Log);
+
+DECLARE_STATS_GROUP(TEXT("RgbPose LiveLink"), STATGROUP_RgbPoseLiveLink, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Parse Datagram"), STAT_RgbPoseParse, STATGROUP_RgbPoseLiveLink);
+DECLARE_CYCLE_STAT(TEXT("Push Frame"), STAT_RgbPosePush, STATGROUP_RgbPoseLiveLink);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Datagrams Received"), STAT_RgbPoseDatagramsReceived, STATGROUP_RgbPoseLiveLink);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Datagrams Per Second"), STAT_RgbPoseDatagramsPerSecond, STATGROUP_RgbPoseLiveLink);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bones Pushed"), STAT_RgbPoseBonesPushed, STATGROUP_RgbPoseLiveLink);
+
 #define RECV_BUFFER_SIZE 1024 * 1024
 
+// Length of each window the smallest sender clock offset is taken over
+#define CLOCK_OFFSET_WINDOW_SECONDS 5.0
+
 FRgbPoseLiveLinkSource::FRgbPoseLiveLinkSource(FIPv4Endpoint InEndpoint)
 : Socket(nullptr)
+, SocketSubsystem(nullptr)
 , Stopping(false)
 , Thread(nullptr)
 , WaitTime(FTimespan::FromMilliseconds(100))
+, bBusyPoll(false)
+, MaxDatagramsPerWakeup(64)
+, bDecodeOnReceiveThread(false)
+, bCoalesceFrames(false)
+, SupersededSequences(nullptr)
+, CurrentWindowClockOffset(TNumericLimits<double>::Max())
+, PreviousWindowClockOffset(TNumericLimits<double>::Max())
 {
 	// defaults
 	DeviceEndpoint = InEndpoint;
@@ -65,14 +91,10 @@ FRgbPoseLiveLinkSource::FRgbPoseLiveLinkSource(FIPv4Endpoint InEndpoint)
 			.WithReceiveBufferSize(RECV_BUFFER_SIZE);
 	}
 
-	RecvBuffer.SetNumUninitialized(RECV_BUFFER_SIZE);
-
 	if ((Socket != nullptr) && (Socket->GetSocketType() == SOCKTYPE_Datagram))
 	{
 		SocketSubsystem = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM);
 
-		Start();
-
 		SourceStatus = LOCTEXT("SourceStatus_Receiving", "Receiving");
 	}
 }
@@ -99,6 +121,62 @@ void FRgbPoseLiveLinkSource::ReceiveClient(ILiveLinkClient* InClient, FGuid InSo
 	SourceGuid = InSourceGuid;
 }
 
+void FRgbPoseLiveLinkSource::InitializeSettings(ULiveLinkSourceSettings* Settings)
+{
+	///		SETTINGS ONLY APPLY BEFORE THE SOCKET THREAD STARTS, SWITCHING THE DECODING THREAD LATER WOULD LET BOTH THREADS DECODE
+	if (Thread != nullptr)
+	{
+		return;
+	}
+
+	const URgbPoseLiveLinkSourceSettings* RgbPoseSettings = Cast<URgbPoseLiveLinkSourceSettings>(Settings);
+	const URgbPoseLiveLinkSourceSettings* Defaults = GetDefault<URgbPoseLiveLinkSourceSettings>();
+	const int32 RingBufferDepth = RgbPoseSettings ? RgbPoseSettings->RingBufferDepth : Defaults->RingBufferDepth;
+	const int32 MaxDatagramSize = RgbPoseSettings ? RgbPoseSettings->MaxDatagramSize : Defaults->MaxDatagramSize;
+	bDecodeOnReceiveThread = RgbPoseSettings ? RgbPoseSettings->bDecodeOnReceiveThread : Defaults->bDecodeOnReceiveThread;
+	bCoalesceFrames = RgbPoseSettings ? RgbPoseSettings->bCoalesceFrames : Defaults->bCoalesceFrames;
+	WaitTime = FTimespan::FromMilliseconds(RgbPoseSettings ? RgbPoseSettings->WaitTimeMs : Defaults->WaitTimeMs);
+	bBusyPoll = RgbPoseSettings ? RgbPoseSettings->bBusyPoll : Defaults->bBusyPoll;
+	MaxDatagramsPerWakeup = FMath::Max(RgbPoseSettings ? RgbPoseSettings->MaxDatagramsPerWakeup : Defaults->MaxDatagramsPerWakeup, 1);
+	FragmentAssembler.SetTimeout((RgbPoseSettings ? RgbPoseSettings->FragmentTimeoutMs : Defaults->FragmentTimeoutMs) * 0.001);
+
+	///		THE RING IS SIZED BEFORE THE SOCKET THREAD STARTS, ONE SPARE BYTE PER SLOT TELLS A FULL DATAGRAM FROM A TRUNCATED ONE
+	if (Socket != nullptr && SocketSubsystem != nullptr)
+	{
+		DatagramRing.Initialize(RingBufferDepth, MaxDatagramSize + 1);
+		Start();
+	}
+}
+
+TSubclassOf<ULiveLinkSourceSettings> FRgbPoseLiveLinkSource::GetSettingsClass() const
+{
+	return URgbPoseLiveLinkSourceSettings::StaticClass();
+}
+
+void FRgbPoseLiveLinkSource::Update()
+{
+	///		THE COALESCER, FRAGMENT ASSEMBLER AND PARSE STATE BELONG TO WHICHEVER THREAD DECODES, NEVER TO BOTH
+	if (bDecodeOnReceiveThread)
+	{
+		return;
+	}
+
+	///		DRAINING AT MOST ONE RING'S WORTH PER TICK SO A FAST SENDER CANNOT KEEP THE GAME THREAD HERE
+	for (int32 count = 0; count < DatagramRing.GetCapacity(); count++)
+	{
+		int32 Num = 0;
+		double ReceiveTime = 0.0;
+		const uint8* Datagram = DatagramRing.BeginRead(Num, ReceiveTime);
+		if (Datagram == nullptr)
+		{
+			break;
+		}
+		HandleOrCoalesce(Datagram, Num, ReceiveTime);
+		DatagramRing.EndRead();
+	}
+	FlushCoalescedFrames();
+}
+
 bool FRgbPoseLiveLinkSource::IsSourceStillValid() const
 {
 	// Source is valid if we have a valid thread and socket
@@ -106,6 +184,31 @@ bool FRgbPoseLiveLinkSource::IsSourceStillValid() const
 	return bIsSourceValid;
 }
 
+FText FRgbPoseLiveLinkSource::GetSourceStatus() const
+{
+	if (Socket == nullptr)
+	{
+		return SourceStatus;
+	}
+	const int32 NumLost = FramesLost.GetValue();
+	const int32 NumSent = FramesAccepted.GetValue() + NumLost;
+	FFormatOrderedArguments Arguments;
+	Arguments.Add(SourceStatus);
+	Arguments.Add(FText::AsNumber(StaticDataPushesSkipped.GetValue()));
+	Arguments.Add(FText::AsNumber(DatagramRing.GetNumOverflows()));
+	Arguments.Add(FText::AsNumber(DatagramRing.GetNumDropped()));
+	Arguments.Add(FText::AsNumber(FrameCoalescer.GetNumStaleDropped()));
+	Arguments.Add(FText::AsNumber(NumLost));
+	Arguments.Add(FText::AsPercent(NumSent > 0 ? (double)NumLost / NumSent : 0.0));
+	Arguments.Add(FText::AsNumber(LateFramesDropped.GetValue()));
+	Arguments.Add(FText::AsNumber(DuplicateFramesDropped.GetValue()));
+	Arguments.Add(FText::AsNumber(DeltasWithoutKeyframe.GetValue()));
+	Arguments.Add(FText::AsNumber(FragmentAssembler.GetNumReassembled()));
+	Arguments.Add(FText::AsNumber(FragmentAssembler.GetNumEvicted()));
+	return FText::Format(LOCTEXT("SourceStatus_ReceivingStats", "{0} (static data pushes skipped: {1}, ring overflows: {2}, datagrams dropped: {3}, stale frames dropped: {4}, frames lost: {5} ({6}), late frames dropped: {7}, duplicate frames dropped: {8}, deltas without keyframe: {9}, messages reassembled: {10}, incomplete messages evicted: {11})"),
+		Arguments);
+}
+
 bool FRgbPoseLiveLinkSource::RequestSourceShutdown()
 {
 	Stop();
@@ -154,29 +257,93 @@ void FRgbPoseLiveLinkSource::Stop()
 uint32 FRgbPoseLiveLinkSource::Run()
 {
 	TSharedRef<FInternetAddr> Sender = SocketSubsystem->CreateInternetAddr();
+	int32 DatagramsThisSecond = 0;
+	double RateWindowStart = FPlatformTime::Seconds();
 	
 	while (!Stopping)
 	{
-		if (Socket->Wait(ESocketWaitConditions::WaitForRead, WaitTime))
+		///		BUSY POLLING SKIPS THE WAIT AND GOES STRAIGHT TO THE NON-BLOCKING RECEIVES BELOW
+		if (bBusyPoll || Socket->Wait(ESocketWaitConditions::WaitForRead, WaitTime))
 		{
-			uint32 Size;
-
-			while (Socket->HasPendingData(Size))
+			///		DRAINING THE SOCKET WITH ONE RECEIVE PER DATAGRAM UNTIL IT WOULD BLOCK, INSTEAD OF A PENDING-DATA QUERY BEFORE EACH ONE
+			int32 NumReceived = 0;
+			bool bRingBlocked = false;
+			while (NumReceived < MaxDatagramsPerWakeup)
 			{
+				///		RECEIVING STRAIGHT INTO A RING SLOT, THE GAME THREAD PICKS IT UP IN Update()
+				uint8* Slot = DatagramRing.BeginWrite();
+				if (Slot == nullptr)
+				{
+					// The game thread is still reading the slot, leave the datagram queued in the socket
+					bRingBlocked = true;
+					break;
+				}
+
 				int32 Read = 0;
+				if (!Socket->RecvFrom(Slot, DatagramRing.GetSlotSize(), Read, *Sender))
+				{
+					// Oversized datagrams fail on some platforms and are truncated on others
+					const ESocketErrors Error = SocketSubsystem->GetLastErrorCode();
+					DatagramRing.CancelWrite(Error == SE_EMSGSIZE);
+					NumReceived++;
+					if (Error == SE_EWOULDBLOCK)
+					{
+						break;
+					}
+					continue;
+				}
+				if (Read == 0)
+				{
+					// Would block, reported as an empty successful read
+					DatagramRing.CancelWrite(false);
+					break;
+				}
+				const double ReceiveTime = FPlatformTime::Seconds();
+				NumReceived++;
+				DatagramsThisSecond++;
+				INC_DWORD_STAT(STAT_RgbPoseDatagramsReceived);
 
-				if (Socket->RecvFrom(RecvBuffer.GetData(), RecvBuffer.Num(), Read, *Sender))
+				if (Read < DatagramRing.GetSlotSize())
 				{
-					if (Read > 0)
+					if (bDecodeOnReceiveThread)
 					{
-						TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> ReceivedData = MakeShareable(new TArray<uint8>());
-						ReceivedData->SetNumUninitialized(Read);
-						memcpy(ReceivedData->GetData(), RecvBuffer.GetData(), Read);
-						AsyncTask(ENamedThreads::GameThread, [this, ReceivedData]() { HandleReceivedData2(ReceivedData); });
+						///		DECODING IN THE SLOT AND PUSHING FROM HERE, THE SLOT IS ONLY USED AS A RECEIVE BUFFER
+						HandleOrCoalesce(Slot, Read, ReceiveTime);
+						DatagramRing.CancelWrite(false);
+					}
+					else
+					{
+						DatagramRing.CommitWrite(Read, ReceiveTime);
 					}
 				}
+				else
+				{
+					DatagramRing.CancelWrite(true);
+				}
+			}
+
+			if (bDecodeOnReceiveThread)
+			{
+				FlushCoalescedFrames();
+			}
+			///		THE SOCKET STILL HOLDS DATA WHILE THE RING IS BLOCKED, SO Wait() WOULD RETURN AT ONCE AND SPIN
+			if (bRingBlocked && !bBusyPoll)
+			{
+				FPlatformProcess::Sleep((float)WaitTime.GetTotalSeconds());
+			}
+			else if (bBusyPoll && NumReceived == 0)
+			{
+				FPlatformProcess::YieldThread();
 			}
 		}
+
+		const double Now = FPlatformTime::Seconds();
+		if (Now - RateWindowStart >= 1.0)
+		{
+			SET_DWORD_STAT(STAT_RgbPoseDatagramsPerSecond, FMath::RoundToInt(DatagramsThisSecond / (Now - RateWindowStart)));
+			DatagramsThisSecond = 0;
+			RateWindowStart = Now;
+		}
 	}
 	return 0;
 }
@@ -191,66 +358,363 @@ FVector FRgbPoseLiveLinkSource::TriangleNormal(FVector a, FVector b, FVector c)
 	return dd;
 }
 
-void FRgbPoseLiveLinkSource::HandleReceivedData2(TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> ReceivedData)
+void FRgbPoseLiveLinkSource::HandleOrCoalesce(const uint8* ReceivedData, int32 Num, double ReceiveTime)
 {
-	/// CONVERTNG TO STRING
-	FString recvedString;
-	int32 Read = ReceivedData->Num();
-	recvedString.Empty(ReceivedData->Num());
-	for (uint8& Byte : *ReceivedData.Get())
-	{
-		recvedString += TCHAR(Byte);
-	}
-	///		CONVERTING TO POSE FRAME MAP ( BONENAME -> TRANSFORMS)
-	TArray<FString> PoseMessageArray;
-	recvedString.ParseIntoArray(PoseMessageArray, TEXT("||"), false);
-	PoseFrame poseFrame = PoseFrame(PoseMessageArray);
-	
-	///		LIVE LINK SUBJECT NAME
-	FString Subname;
-	Subname = poseFrame.Subjectname;
-	FName SubjectName = FName(*Subname);
+	///		POSES WAIT FOR THE END OF THE BATCH SO ONLY THE NEWEST PER SUBJECT IS DECODED
+	if (bCoalesceFrames && FrameCoalescer.Add(ReceivedData, Num, ReceiveTime))
+	{
+		return;
+	}
+
+	///		ANYTHING ELSE KEEPS ITS PLACE IN THE STREAM, SO EARLIER POSES ARE PUSHED BEFORE IT
+	FlushCoalescedFrames();
+	HandleReceivedData2(ReceivedData, Num, ReceiveTime);
+}
 
-	if (Subname_list.Num()==0)
+void FRgbPoseLiveLinkSource::FlushCoalescedFrames()
+{
+	if (bCoalesceFrames)
+	{
+		FrameCoalescer.Flush([this](const uint8* Datagram, int32 Num, double ReceiveTime, const TArray<uint32>& Superseded)
+		{
+			SupersededSequences = &Superseded;
+			HandleReceivedData2(Datagram, Num, ReceiveTime);
+			SupersededSequences = nullptr;
+		});
+	}
+}
+
+void FRgbPoseLiveLinkSource::HandleReceivedData2(const uint8* ReceivedData, int32 Num, double ReceiveTime)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FRgbPoseLiveLinkSource::HandleReceivedData2);
+	UE_LOG(LogRgbPoseLiveLink, VeryVerbose, TEXT("Handling a %d byte datagram"), Num);
+
+	///		BINARY SENDERS ARE RECOGNISED BY THE PACKET MAGIC, EVERYTHING ELSE IS THE TEXT PROTOCOL
+	if (RgbPoseProtocol::IsBinaryPacket(ReceivedData, Num))
+	{
+		HandleBinaryPacket(ReceivedData, Num, ReceiveTime);
+		return;
+	}
+
+	///		PARSING THE DATAGRAM IN PLACE INTO THE REUSED POSE FRAME ( BONENAME -> TRANSFORMS)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_RgbPoseParse);
+		///		LATE AND DUPLICATED SUBJECTS ARE REJECTED FROM THEIR STAMP, BEFORE THEIR BONES ARE READ
+		auto AcceptStamp = [this](FName SubjectName, const FPoseFrameStamp& Stamp) { return AcceptSequence(SubjectName, Stamp.Sequence); };
+		if (!TextFrame.ParseText(ReceivedData, Num, AcceptStamp))
+		{
+			return;
+		}
+	}
+	const double ParseTime = FPlatformTime::Seconds();
+
+	///		HIERARCHIES ARRIVE ONCE PER SKELETON AND APPLY TO EVERY FOLLOWING POSE OF THAT SUBJECT
+	for (const TPair<FName, TArray<int32>>& pair : TextFrame.BoneParents)
+	{
+		SubjectBoneParents.Add(pair.Key, pair.Value);
+	}
+
+	///		EVERY ARMATURE OF THE DATAGRAM GOES TO ITS OWN SUBJECT
+	for (int32 subjectIndex = 0; subjectIndex < TextFrame.NumSubjects; subjectIndex++)
+	{
+		const FPoseFrameSubject& subject = TextFrame.Subjects[subjectIndex];
+		if (!subject.Name.IsNone())
+		{
+			PushSkeletonFrame(subject.Name, subject.BoneNames, subject.BoneTransforms, MakeFrameTiming(subject.Stamp.SendTimeMicros, ReceiveTime, ParseTime));
+		}
+	}
+
+	///		OBJECTS ARE RIGID, EACH ONE IS A TRANSFORM SUBJECT OF ITS OWN
+	for (int32 objectIndex = 0; objectIndex < TextFrame.ObjectNames.Num(); objectIndex++)
+	{
+		PushTransformFrame(TextFrame.ObjectNames[objectIndex], TextFrame.ObjectTransforms[objectIndex], MakeFrameTiming(TextFrame.ObjectStamps[objectIndex].SendTimeMicros, ReceiveTime, ParseTime));
+	}
+}
+
+void FRgbPoseLiveLinkSource::HandleBinaryPacket(const uint8* ReceivedData, int32 Num, double ReceiveTime)
+{
+	///		A DATAGRAM CAN CARRY PACKETS OF SEVERAL SUBJECTS BACK TO BACK, EACH ONE IS HANDLED AS IT IS REACHED
+	FRgbPosePacketHeader Header;
+	const uint8* Payload = nullptr;
+	while (RgbPoseProtocol::ReadHeader(ReceivedData, Num, Header, Payload))
+	{
+		HandleBinaryPacket(Header, Payload, ReceiveTime);
+		const int32 PacketSize = Header.HeaderSize + Header.PayloadSize;
+		ReceivedData += PacketSize;
+		Num -= PacketSize;
+	}
+}
+
+void FRgbPoseLiveLinkSource::HandleBinaryPacket(const FRgbPosePacketHeader& Header, const uint8* Payload, double ReceiveTime)
+{
+	switch ((ERgbPosePacketType)Header.PacketType)
+	{
+	case ERgbPosePacketType::Skeleton:
+	{
+		///		SKELETON PACKETS ANNOUNCE THE SUBJECT NAME AND BONE NAMES BEHIND A SUBJECT ID
+		SCOPE_CYCLE_COUNTER(STAT_RgbPoseParse);
+		FRgbPoseBinarySubject& BinarySubject = BinarySubjects.FindOrAdd(Header.SubjectId);
+		if (!RgbPoseProtocol::ReadSkeleton(Header, Payload, BinarySubject.SubjectName, BinarySubject.BoneNames, BinarySubject.BoneParents))
+		{
+			BinarySubjects.Remove(Header.SubjectId);
+		}
+		else if (BinarySubject.BoneParents.Num() > 0)
+		{
+			SubjectBoneParents.Add(BinarySubject.SubjectName, BinarySubject.BoneParents);
+		}
+		break;
+	}
+	case ERgbPosePacketType::Pose:
+	{
+		///		POSES OF SUBJECTS WE HAVE NOT SEEN A SKELETON PACKET FOR YET ARE DROPPED
+		FRgbPoseBinarySubject* BinarySubject = BinarySubjects.Find(Header.SubjectId);
+		if (BinarySubject == nullptr || BinarySubject->BoneNames.Num() != Header.BoneCount)
+		{
+			return;
+		}
+		///		LATE AND DUPLICATED POSES ARE DROPPED FROM THEIR HEADER, WITHOUT DECODING THEM
+		const bool bNewest = AcceptSequence(BinarySubject->SubjectName, Header.FrameNumber);
+		const bool bKeyframe = (Header.Flags & ERgbPosePacketFlags::Keyframe) != 0;
+		const bool bNewerKeyframe = bKeyframe && (!BinarySubject->bHasKeyframe || (int32)(Header.FrameNumber - BinarySubject->KeyframeSequence) > 0);
+		if (!bNewest && !bNewerKeyframe)
+		{
+			return;
+		}
+		bool bDecoded = false;
+		{
+			SCOPE_CYCLE_COUNTER(STAT_RgbPoseParse);
+			bDecoded = RgbPoseProtocol::ReadPose(Header, Payload, BinaryPose);
+		}
+		if (!bDecoded)
+		{
+			return;
+		}
+		///		A LATE KEYFRAME IS STILL KEPT FOR THE DELTAS THAT REFER TO IT, IT IS JUST NOT PUSHED
+		if (bNewerKeyframe)
+		{
+			BinarySubject->KeyframePose = BinaryPose;
+			BinarySubject->KeyframeSequence = Header.FrameNumber;
+			BinarySubject->bHasKeyframe = true;
+		}
+		if (bNewest)
+		{
+			ConvertBinaryPose(Header);
+			PushSkeletonFrame(BinarySubject->SubjectName, BinarySubject->BoneNames, BinaryTransforms, MakeFrameTiming(Header.SendTimeMicros, ReceiveTime, FPlatformTime::Seconds()));
+		}
+		break;
+	}
+	case ERgbPosePacketType::PoseDelta:
 	{
-		FLiveLinkSubjectPreset Preset;
-		Preset.Key = FLiveLinkSubjectKey(SourceGuid, SubjectName);
-		Client->CreateSubject(Preset);
-		Subname_list.Push(poseFrame.Subjectname);
+		const FRgbPoseBinarySubject* BinarySubject = BinarySubjects.Find(Header.SubjectId);
+		if (BinarySubject == nullptr || BinarySubject->BoneNames.Num() != Header.BoneCount)
+		{
+			return;
+		}
+		if (!AcceptSequence(BinarySubject->SubjectName, Header.FrameNumber))
+		{
+			return;
+		}
+		///		ONLY THE BONES THAT MOVED ARE SENT, THE REST ARE TAKEN FROM THE KEYFRAME THE DELTA WAS ENCODED AGAINST
+		FRgbPoseDeltaHeader DeltaHeader;
+		bool bDecoded = false;
+		{
+			SCOPE_CYCLE_COUNTER(STAT_RgbPoseParse);
+			if (!RgbPoseProtocol::ReadDeltaHeader(Header, Payload, DeltaHeader))
+			{
+				return;
+			}
+			if (!BinarySubject->bHasKeyframe || BinarySubject->KeyframeSequence != DeltaHeader.KeyframeSequence)
+			{
+				DeltasWithoutKeyframe.Increment();
+				return;
+			}
+			bDecoded = RgbPoseProtocol::ReadPoseDelta(Header, Payload, DeltaHeader, BinarySubject->KeyframePose, BinaryPose);
+		}
+		if (bDecoded)
+		{
+			ConvertBinaryPose(Header);
+			PushSkeletonFrame(BinarySubject->SubjectName, BinarySubject->BoneNames, BinaryTransforms, MakeFrameTiming(Header.SendTimeMicros, ReceiveTime, FPlatformTime::Seconds()));
+		}
+		break;
 	}
-		if (!Subname_list.Contains(poseFrame.Subjectname))
+	case ERgbPosePacketType::Fragment:
+	{
+		///		A LARGE MESSAGE IS HANDLED LIKE ANY DATAGRAM ONCE ITS LAST MISSING FRAGMENT ARRIVES
+		FRgbPoseFragmentHeader Fragment;
+		const uint8* Chunk = nullptr;
+		int32 ChunkSize = 0;
+		TArray<uint8> Message;
+		if (RgbPoseProtocol::ReadFragment(Header, Payload, Fragment, Chunk, ChunkSize) && FragmentAssembler.Add(Fragment, Chunk, ChunkSize, ReceiveTime, Message))
 		{
-			FLiveLinkSubjectPreset Preset;
-			Preset.Key = FLiveLinkSubjectKey(SourceGuid, SubjectName);
-			Client->CreateSubject(Preset);
-			Subname_list.Push(poseFrame.Subjectname);
+			HandleReceivedData2(Message.GetData(), Message.Num(), ReceiveTime);
 		}
-		///		CREATING FRAME DATA TO SEND 
-		Client->SetSubjectEnabled(FLiveLinkSubjectKey(SourceGuid, SubjectName),true);
-		FTimer timer;
-		FLiveLinkFrameDataStruct FrameData1(FLiveLinkAnimationFrameData::StaticStruct());
-		FLiveLinkAnimationFrameData& AnimFrameData = *FrameData1.Cast<FLiveLinkAnimationFrameData>();
-		AnimFrameData.WorldTime = FLiveLinkWorldTime((double)(timer.GetCurrentTime()));
-
-		///		DEFINING SKELETON STRUCTURE DATA 
-			AddStaticSkeletonData(SubjectName, poseFrame.BoneName_TransformMap);
-		///		SENDING ACTUAL TRANSFORMS TO ANIM FRAME DATA ACCORDING TO THE SKELETON STRUCTURE DEFINED 
-		int count = 0;
-		TArray<FTransform> transforms;
-		transforms.Reset(poseFrame.BoneName_TransformMap.Num());
-		int32 transformIndex = transforms.AddUninitialized(poseFrame.BoneName_TransformMap.Num());
-		bool first = true;
-
-		for (const TPair<FString, FTransform>& pair : poseFrame.BoneName_TransformMap)
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+bool FRgbPoseLiveLinkSource::EnsureSubject(FName SubjectName, TSubclassOf<ULiveLinkRole> Role)
+{
+	if (const TSharedRef<FThreadSafeBool, ESPMode::ThreadSafe>* Created = Subname_list.Find(SubjectName))
+	{
+		return **Created;
+	}
+
+	///		SUBJECTS CAN ONLY BE CREATED ON THE GAME THREAD, THE TASK ONLY HOLDS THE CLIENT AND FLAG SO IT OUTLIVES THE SOURCE SAFELY
+	TSharedRef<FThreadSafeBool, ESPMode::ThreadSafe> Created = MakeShared<FThreadSafeBool, ESPMode::ThreadSafe>(false);
+	Subname_list.Add(SubjectName, Created);
+
+	FLiveLinkSubjectPreset Preset;
+	Preset.Key = FLiveLinkSubjectKey(SourceGuid, SubjectName);
+	Preset.Role = Role;
+	Preset.bEnabled = true;
+	ILiveLinkClient* LiveLinkClient = Client;
+	auto CreateSubject = [LiveLinkClient, Preset, Created]()
+	{
+		LiveLinkClient->CreateSubject(Preset);
+		LiveLinkClient->SetSubjectEnabled(Preset.Key, true);
+		*Created = true;
+	};
+
+	if (IsInGameThread())
+	{
+		CreateSubject();
+		return true;
+	}
+	///		FRAMES OF THE SUBJECT ARE SKIPPED UNTIL THE GAME THREAD HAS CREATED IT
+	AsyncTask(ENamedThreads::GameThread, MoveTemp(CreateSubject));
+	return false;
+}
+
+bool FRgbPoseLiveLinkSource::AcceptSequence(FName SubjectName, uint32 Sequence)
+{
+	FRgbPoseSequenceWindow& Window = SubjectSequences.FindOrAdd(SubjectName);
+	int32 LostChange = 0;
+
+	///		FRAMES THE COALESCER SKIPPED DID ARRIVE, THEY ARE STALE DROPS RATHER THAN LOST, LATE OR DUPLICATED ONES
+	if (SupersededSequences != nullptr)
+	{
+		for (uint32 Superseded : *SupersededSequences)
 		{
+			if (Window.Add(Superseded, LostChange) == ERgbPoseSequenceResult::Newer)
 			{
-				transforms[count] = pair.Value;
+				FramesAccepted.Increment();
 			}
-			count++;
+			FramesLost.Add(LostChange);
 		}
+		SupersededSequences = nullptr;
+	}
+
+	switch (Window.Add(Sequence, LostChange))
+	{
+	case ERgbPoseSequenceResult::Newer:
+		FramesAccepted.Increment();
+		FramesLost.Add(LostChange);
+		return true;
+	case ERgbPoseSequenceResult::Late:
+		// A late frame that was counted lost did arrive after all
+		FramesLost.Add(LostChange);
+		LateFramesDropped.Increment();
+		return false;
+	default:
+		DuplicateFramesDropped.Increment();
+		return false;
+	}
+}
+
+void FRgbPoseLiveLinkSource::ConvertBinaryPose(const FRgbPosePacketHeader& Header)
+{
+	///		THE WHOLE POSE IS CONVERTED COMPONENT BY COMPONENT, TRANSFORMS ARE ONLY BUILT FOR LIVELINK
+	SCOPE_CYCLE_COUNTER(STAT_RgbPoseParse);
+	if ((Header.Flags & ERgbPosePacketFlags::BlenderSpace) != 0)
+	{
+		BinaryPose.ConvertSpace(RgbPoseProtocol::GetBlenderSpaceConversion());
+	}
+	BinaryPose.NormalizeRotations();
+	BinaryPose.ToTransforms(BinaryTransforms);
+}
 
-		AnimFrameData.Transforms.Append(transforms);
-		Client->PushSubjectFrameData_AnyThread(FLiveLinkSubjectKey(SourceGuid, SubjectName), MoveTemp(FrameData1));
+FRgbPoseFrameTiming FRgbPoseLiveLinkSource::MakeFrameTiming(uint64 SendTimeMicros, double ReceiveTime, double ParseTime)
+{
+	FRgbPoseFrameTiming Timing;
+	Timing.ReceiveTime = ReceiveTime;
+	Timing.ParseTime = ParseTime;
+	if (SendTimeMicros == 0)
+	{
+		return Timing;
+	}
+
+	///		THE SMALLEST OFFSET OF THE LAST TWO WINDOWS FOLLOWS CLOCK DRIFT AND SENDER RESTARTS WITHOUT JUMPING ON A SINGLE LATE FRAME
+	const double SendTime = SendTimeMicros * 1e-6;
+	const double ClockOffset = ReceiveTime - SendTime;
+	if (ReceiveTime - ClockOffsetWindowStart >= CLOCK_OFFSET_WINDOW_SECONDS)
+	{
+		PreviousWindowClockOffset = CurrentWindowClockOffset;
+		CurrentWindowClockOffset = ClockOffset;
+		ClockOffsetWindowStart = ReceiveTime;
+	}
+	else
+	{
+		CurrentWindowClockOffset = FMath::Min(CurrentWindowClockOffset, ClockOffset);
+	}
+	Timing.SendTime = SendTime + FMath::Min(CurrentWindowClockOffset, PreviousWindowClockOffset);
+	Timing.bHasSendTime = true;
+	return Timing;
+}
+
+void FRgbPoseLiveLinkSource::RecordLatency(FName SubjectName, const FRgbPoseFrameTiming& Timing)
+{
+	if (!Timing.bHasSendTime)
+	{
+		return;
+	}
+	FRgbPoseLatencyTracker& Tracker = FRgbPoseLatencyTracker::Get();
+	Tracker.AddSample(SubjectName, ERgbPoseLatencyStage::Receive, Timing.ReceiveTime - Timing.SendTime);
+	Tracker.AddSample(SubjectName, ERgbPoseLatencyStage::Parse, Timing.ParseTime - Timing.SendTime);
+	Tracker.AddSample(SubjectName, ERgbPoseLatencyStage::Push, FPlatformTime::Seconds() - Timing.SendTime);
+}
+
+void FRgbPoseLiveLinkSource::PushSkeletonFrame(FName SubjectName, const TArray<FName>& BoneNames, const TArray<FTransform>& Transforms, const FRgbPoseFrameTiming& Timing)
+{
+	TRACE_CPUPROFILER_EVENT_SCOPE(FRgbPoseLiveLinkSource::PushSkeletonFrame);
+	SCOPE_CYCLE_COUNTER(STAT_RgbPosePush);
+	if (!EnsureSubject(SubjectName, ULiveLinkAnimationRole::StaticClass()))
+	{
+		return;
+	}
+	INC_DWORD_STAT_BY(STAT_RgbPoseBonesPushed, Transforms.Num());
+
+	///		CREATING FRAME DATA TO SEND, STAMPED WITH WHEN BLENDER SENT IT OR, FOR OLDER SENDERS, WHEN IT ARRIVED
+	FLiveLinkFrameDataStruct FrameData1(FLiveLinkAnimationFrameData::StaticStruct());
+	FLiveLinkAnimationFrameData& AnimFrameData = *FrameData1.Cast<FLiveLinkAnimationFrameData>();
+	AnimFrameData.WorldTime = FLiveLinkWorldTime(Timing.bHasSendTime ? Timing.SendTime : Timing.ReceiveTime);
+
+	///		DEFINING SKELETON STRUCTURE DATA 
+	AddStaticSkeletonData(SubjectName, BoneNames);
+	///		SENDING ACTUAL TRANSFORMS TO ANIM FRAME DATA ACCORDING TO THE SKELETON STRUCTURE DEFINED 
+	AnimFrameData.Transforms.Append(Transforms);
+	Client->PushSubjectFrameData_AnyThread(FLiveLinkSubjectKey(SourceGuid, SubjectName), MoveTemp(FrameData1));
+	RecordLatency(SubjectName, Timing);
+}
+
+void FRgbPoseLiveLinkSource::PushTransformFrame(FName SubjectName, const FTransform& Transform, const FRgbPoseFrameTiming& Timing)
+{
+	SCOPE_CYCLE_COUNTER(STAT_RgbPosePush);
+	if (!EnsureSubject(SubjectName, ULiveLinkTransformRole::StaticClass()))
+	{
+		return;
+	}
+
+	AddStaticTransformData(SubjectName);
+
+	FLiveLinkFrameDataStruct FrameData(FLiveLinkTransformFrameData::StaticStruct());
+	FLiveLinkTransformFrameData& TransformData = *FrameData.Cast<FLiveLinkTransformFrameData>();
+	TransformData.WorldTime = FLiveLinkWorldTime(Timing.bHasSendTime ? Timing.SendTime : Timing.ReceiveTime);
+	TransformData.Transform = Transform;
+	Client->PushSubjectFrameData_AnyThread(FLiveLinkSubjectKey(SourceGuid, SubjectName), MoveTemp(FrameData));
+	RecordLatency(SubjectName, Timing);
 }
 
 FTransform FRgbPoseLiveLinkSource::CalculateLookRotaion(FVector Source, FVector Target)
@@ -388,82 +852,6 @@ void FRgbPoseLiveLinkSource::CreateJoint(TArray<FTransform>& transforms, bool ha
 //	Client->PushSubjectFrameData_AnyThread(FLiveLinkSubjectKey(SourceGuid, SubjectName), MoveTemp(FrameData));
 //}
 
-//With Animations 
-void FRgbPoseLiveLinkSource::HandleReceivedData(TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> ReceivedData)
-{
-	FString recvedString;
-	int32 Read = ReceivedData->Num();
-	recvedString.Empty(ReceivedData->Num());
-	for (uint8& Byte : *ReceivedData.Get())
-	{
-		recvedString += TCHAR(Byte);
-	}
-	// UE_LOG(LogTemp, Warning, TEXT("num bytes = %i,    %s"), Read, *recvedString);
-	TArray<FString> PoseMessageArray;
-	recvedString.ParseIntoArray(PoseMessageArray, TEXT("|"), false);
-	PoseMessageArray.RemoveAt(PoseMessageArray.Num() - 1);
-	double currentTime = FPlatformTime::Seconds();
-	//UE_LOG(LogTemp, Warning, TEXT("%f"), 1.0 / (currentTime - LastFrameTime));
-	LastFrameTime = currentTime;
-	FTimer timer;
-
-	PoseFrame poseFrame = PoseFrame(PoseMessageArray);
-	//FTransform currentFrameTransform(*poseFrame.PoseFrameRot.Find(FString("Cube")), *poseFrame.PoseFrameMap.Find(FString("Cube")));
-	// static FLiveLinkFrameData LiveLinkFrame;
-	///		LIVE LINK SUBJECT NAME
-	FString Subname;
-	Subname = poseFrame.Subjectname;
-	FName SubjectName = FName(*Subname);
-
-		FLiveLinkSubjectKey Key = FLiveLinkSubjectKey(SourceGuid, SubjectName);
-		Client->SetSubjectEnabled(Key,true);
-		AddStaticSkeletonData(SubjectName, poseFrame.BoneName_TransformMap);
-		FLiveLinkFrameDataStruct FrameData(FLiveLinkAnimationFrameData::StaticStruct());
-		FLiveLinkAnimationFrameData& AnimationData = *FrameData.Cast<FLiveLinkAnimationFrameData>();
-		//AnimationData.Transforms.Reserve(1);
-		AnimationData.WorldTime = FLiveLinkWorldTime(currentTime);
-		//AnimationData.Transforms.Reserve(1);
-
-		//Addding transforms to data frame
-		TArray<FTransform> transforms;
-		transforms.Reset(poseFrame.BoneName_TransformMap.Num());
-		//int count = 0;
-		for (const TPair<FString, FTransform>& pair : poseFrame.BoneName_TransformMap)
-		{
-			int32 transformIndex = transforms.AddUninitialized(1);
-			transforms[transformIndex] = pair.Value;
-			//boneNames.Add(FName(*pair.Key));
-			//boneParents.Add(count); //0 - root
-			//count++;
-		}
-
-		AnimationData.Transforms.Append(transforms);
-		//AnimationData.Transforms.Append(currentFrameTransform);
-		UE_LOG(LogClass, Warning, TEXT("My Int Value: %d"), AnimationData.Transforms.Num());
-		Client->PushSubjectFrameData_AnyThread(Key, MoveTemp(FrameData));
-
-	/*if (false)
-	{
-		FLiveLinkStaticDataStruct StaticData(FLiveLinkSkeletonStaticData::StaticStruct());
-		FLiveLinkSkeletonStaticData* SkeletonData = StaticData.Cast<FLiveLinkSkeletonStaticData>();
-		SkeletonData->PropertyNames.Add("Cube_X");
-		SkeletonData->PropertyNames.Add("Cube_Y");
-		SkeletonData->PropertyNames.Add("Cube_Z");
-		SkeletonData->PropertyNames.Add("Cube_RotX");
-		SkeletonData->PropertyNames.Add("Cube_RotY");
-		SkeletonData->PropertyNames.Add("Cube_RotZ");
-		SkeletonData->PropertyNames.Add("Cube_RotW");
-		Client->PushSubjectStaticData_AnyThread(Key, ULiveLinkAnimationRole::StaticClass(), MoveTemp(StaticData));
-		PoseLabelsLoaded = true;
-	}*/
-	/*FLiveLinkStaticDataStruct StaticData(FLiveLinkTransformStaticData::StaticStruct());
-	FLiveLinkTransformStaticData* TransformDataStatic = StaticData.Cast<FLiveLinkTransformStaticData>();
-	Client->PushSubjectStaticData_AnyThread(Key, ULiveLinkTransformRole::StaticClass(), MoveTemp(StaticData));
-	*/
-	/*AddAnimFrameData(poseFrame.PoseFrameMap.Find(FString("Cube")), AnimFrameData);
-	AddAnimFrameData(poseFrame.PoseFrameRot.Find(FString("Cube")), AnimFrameData);*/
-}
-
 void FRgbPoseLiveLinkSource::AddAnimFrameData(FVector* inVector, FLiveLinkAnimationFrameData& animFrameData)
 {
 	animFrameData.PropertyValues.Add(inVector->X);
@@ -479,27 +867,64 @@ void FRgbPoseLiveLinkSource::AddAnimFrameData(FQuat* inQuat, FLiveLinkAnimationF
 	animFrameData.PropertyValues.Add(inQuat->W);
 }
 
-void FRgbPoseLiveLinkSource::AddStaticSkeletonData(FName subjectName, TMap<FString, FTransform> BoneName_TransformMap)
+void FRgbPoseLiveLinkSource::AddStaticSkeletonData(FName subjectName, const TArray<FName>& BoneNames)
 {
-	//TArray<FName> boneNames;
-	    TArray<FName> boneNames;
+		///		USING THE HIERARCHY SENT BY BLENDER WHEN IT MATCHES THE BONE LIST, A LINEAR CHAIN OTHERWISE
+		const TArray<int32>* sentParents = SubjectBoneParents.Find(subjectName);
+		if (sentParents != nullptr && sentParents->Num() != BoneNames.Num())
+		{
+			sentParents = nullptr;
+		}
+
+		///		STATIC DATA MAKES LIVE LINK REINITIALISE THE SUBJECT, SO IT IS ONLY PUSHED WHEN THE HIERARCHY CHANGES
+		uint32 hierarchyHash = GetTypeHash(BoneNames.Num());
+		for (int32 boneIndex = 0; boneIndex < BoneNames.Num(); boneIndex++)
+		{
+			hierarchyHash = HashCombine(hierarchyHash, GetTypeHash(BoneNames[boneIndex]));
+			hierarchyHash = HashCombine(hierarchyHash, GetTypeHash(sentParents ? (*sentParents)[boneIndex] : boneIndex - 1));
+		}
+		const uint32* pushedHash = StaticDataHashes.Find(subjectName);
+		if (pushedHash != nullptr && *pushedHash == hierarchyHash)
+		{
+			StaticDataPushesSkipped.Increment();
+			return;
+		}
+		StaticDataHashes.Add(subjectName, hierarchyHash);
+
 		TArray<int32> boneParents;
-		int count = 0;
-		for (const TPair<FString, FTransform>& pair : BoneName_TransformMap)
+		boneParents.Reserve(BoneNames.Num());
+		for (int32 count = 0; count < BoneNames.Num(); count++)
 		{
-			boneNames.Add(FName(*pair.Key));
-			int boneParent = (count == 0) ? 0 : (count - 1);
-			boneParents.Add(boneParent); //0 - root
-			count++;
-			//if (count > 2) break;
+			int32 boneParent = sentParents ? (*sentParents)[count] : (count - 1);
+			if (boneParent < 0 || boneParent >= BoneNames.Num() || boneParent == count)
+			{
+				boneParent = INDEX_NONE; //root
+			}
+			boneParents.Add(boneParent);
 		}
 
 		FLiveLinkSubjectKey Key = FLiveLinkSubjectKey(SourceGuid, subjectName);
 		FLiveLinkStaticDataStruct StaticData(FLiveLinkSkeletonStaticData::StaticStruct());
 		FLiveLinkSkeletonStaticData* SkeletonData = StaticData.Cast<FLiveLinkSkeletonStaticData>();
-		SkeletonData->SetBoneNames(boneNames);
+		SkeletonData->SetBoneNames(BoneNames);
 		SkeletonData->SetBoneParents(boneParents);
 		Client->PushSubjectStaticData_AnyThread(Key, ULiveLinkAnimationRole::StaticClass(), MoveTemp(StaticData));
 }
 
+void FRgbPoseLiveLinkSource::AddStaticTransformData(FName subjectName)
+{
+		///		TRANSFORM SUBJECTS HAVE NO HIERARCHY, THEIR STATIC DATA ONLY EVER NEEDS PUSHING ONCE
+		const uint32 roleHash = GetTypeHash(ULiveLinkTransformRole::StaticClass());
+		const uint32* pushedHash = StaticDataHashes.Find(subjectName);
+		if (pushedHash != nullptr && *pushedHash == roleHash)
+		{
+			StaticDataPushesSkipped.Increment();
+			return;
+		}
+		StaticDataHashes.Add(subjectName, roleHash);
+
+		FLiveLinkStaticDataStruct StaticData(FLiveLinkTransformStaticData::StaticStruct());
+		Client->PushSubjectStaticData_AnyThread(FLiveLinkSubjectKey(SourceGuid, subjectName), ULiveLinkTransformRole::StaticClass(), MoveTemp(StaticData));
+}
+
 #undef LOCTEXT_NAMESPACE
@@ -5,19 +5,50 @@
 #include "ILiveLinkSource.h"
 #include "HAL/Runnable.h"
 #include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
 #include "IMessageContext.h"
 #include "Chaos/AABB.h"
 #include "Interfaces/IPv4/IPv4Endpoint.h"
 #include "Roles/LiveLinkAnimationTypes.h"
+#include "PoseFrame.h"
+#include "RgbPoseProtocol.h"
+#include "RgbPoseBuffer.h"
+#include "RgbPoseDatagramRing.h"
+#include "RgbPoseFrameCoalescer.h"
+#include "RgbPoseFragmentAssembler.h"
+#include "RgbPoseSequenceWindow.h"
 
 class FRunnableThread;
 class FSocket;
 class ILiveLinkClient;
+class ULiveLinkRole;
 class ISocketSubsystem;
-class PoseFrame;
 
 //TMap<int32, FString> BoneMap;
 
+// Subject announced by a binary skeleton packet
+struct FRgbPoseBinarySubject
+{
+	FName SubjectName;
+	TArray<FName> BoneNames;
+	TArray<int32> BoneParents;
+
+	// Last keyframe of the subject as it was sent, delta packets are rebuilt on top of it
+	FRgbPoseBuffer KeyframePose;
+	uint32 KeyframeSequence = 0;
+	bool bHasKeyframe = false;
+};
+
+// When a frame was sent, received and decoded, all on the local FPlatformTime::Seconds() clock
+struct FRgbPoseFrameTiming
+{
+	// Sender's timestamp mapped onto the local clock, only set if bHasSendTime
+	double SendTime = 0.0;
+	double ReceiveTime = 0.0;
+	double ParseTime = 0.0;
+	bool bHasSendTime = false;
+};
+
 class RGBPOSELIVELINK_API FRgbPoseLiveLinkSource : public ILiveLinkSource, public FRunnable
 {
 public:
@@ -30,13 +61,19 @@ public:
 	
 	virtual void ReceiveClient(ILiveLinkClient* InClient, FGuid InSourceGuid) override;
 
+	virtual void InitializeSettings(ULiveLinkSourceSettings* Settings) override;
+
 	virtual bool IsSourceStillValid() const override;
 
 	virtual bool RequestSourceShutdown() override;
 
 	virtual FText GetSourceType() const override { return SourceType; };
 	virtual FText GetSourceMachineName() const override { return SourceMachineName; }
-	virtual FText GetSourceStatus() const override { return SourceStatus; }
+	virtual FText GetSourceStatus() const override;
+
+	virtual TSubclassOf<ULiveLinkSourceSettings> GetSettingsClass() const override;
+
+	virtual void Update() override;
 
 	// End ILiveLinkSource Interface
 
@@ -50,9 +87,34 @@ public:
 
 	// End FRunnable Interface
 
-	void HandleReceivedData(TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> ReceivedData);
-	void HandleReceivedData2(TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> ReceivedData);
+	void HandleReceivedData2(const uint8* ReceivedData, int32 Num, double ReceiveTime);
+	void HandleBinaryPacket(const uint8* ReceivedData, int32 Num, double ReceiveTime);
+	void HandleBinaryPacket(const FRgbPosePacketHeader& Header, const uint8* Payload, double ReceiveTime);
+	void HandleOrCoalesce(const uint8* ReceivedData, int32 Num, double ReceiveTime);
+	void FlushCoalescedFrames();
 	FTransform CalculateLookRotaion(FVector Source, FVector Target);
+
+	// Number of skeleton static data pushes avoided because the subject's bone list had not changed
+	int32 GetNumSkippedStaticDataPushes() const { return StaticDataPushesSkipped.GetValue(); }
+
+	// Number of datagrams that arrived while the receive ring was full, and the number lost overall
+	int32 GetNumRingOverflows() const { return DatagramRing.GetNumOverflows(); }
+	int32 GetNumDroppedDatagrams() const { return DatagramRing.GetNumDropped(); }
+
+	// Number of pose datagrams skipped undecoded because a newer one of the same subject was waiting
+	int32 GetNumStaleFramesDropped() const { return FrameCoalescer.GetNumStaleDropped(); }
+
+	// Frames the sender numbered but that never arrived, and those dropped for arriving late or twice
+	int32 GetNumFramesLost() const { return FramesLost.GetValue(); }
+	int32 GetNumLateFramesDropped() const { return LateFramesDropped.GetValue(); }
+	int32 GetNumDuplicateFramesDropped() const { return DuplicateFramesDropped.GetValue(); }
+
+	// Delta frames dropped because the keyframe they were encoded against never arrived
+	int32 GetNumDeltasWithoutKeyframe() const { return DeltasWithoutKeyframe.GetValue(); }
+
+	// Messages rebuilt from fragment packets, and those dropped with fragments still missing
+	int32 GetNumMessagesReassembled() const { return FragmentAssembler.GetNumReassembled(); }
+	int32 GetNumFragmentedMessagesEvicted() const { return FragmentAssembler.GetNumEvicted(); }
 	FVector TriangleNormal(FVector a, FVector b, FVector c);
 
 private:
@@ -87,11 +149,64 @@ private:
 	// Time to wait between attempted receives
 	FTimespan WaitTime;
 
-	// List of subjects we've already encountered
-	TArray<FString>Subname_list;
+	// Spin on the socket instead of waiting on it
+	bool bBusyPoll;
+
+	// Datagrams received in one batch before flushing
+	int32 MaxDatagramsPerWakeup;
+
+	// Subjects we've already encountered, flagged once the game thread has created them in LiveLink
+	TMap<FName, TSharedRef<FThreadSafeBool, ESPMode::ThreadSafe>> Subname_list;
 
-	// Buffer to receive socket data into
-	TArray<uint8> RecvBuffer;
+	// Datagrams are decoded and pushed by the socket thread rather than handed to Update(). Fixed once the thread starts,
+	// everything below that decoding touches is only ever used by the one thread doing it
+	bool bDecodeOnReceiveThread;
+
+	// Only the newest pose per subject is decoded out of each batch
+	bool bCoalesceFrames;
+	FRgbPoseFrameCoalescer FrameCoalescer;
+	// Frame numbers the coalescer dropped for the datagram being decoded, its single subject's first sequence check takes them
+	const TArray<uint32>* SupersededSequences;
+
+	// Real parent indices sent by the Blender side, per subject
+	TMap<FName, TArray<int32>> SubjectBoneParents;
+
+	// Hash of the static data last pushed, per subject, the bone list for skeletons and the role for objects
+	TMap<FName, uint32> StaticDataHashes;
+
+	// Static data pushes avoided because the bone list was unchanged
+	FThreadSafeCounter StaticDataPushesSkipped;
+
+	// Subjects announced by binary skeleton packets, keyed by subject id
+	TMap<uint32, FRgbPoseBinarySubject> BinarySubjects;
+
+	// Text datagrams are parsed into this frame, reused between packets
+	PoseFrame TextFrame;
+
+	// Components of the last binary pose packet and the transforms built from them, reused between packets
+	FRgbPoseBuffer BinaryPose;
+	TArray<FTransform> BinaryTransforms;
+
+	// Sequence numbers seen per subject, frames older than the newest one are dropped before they are decoded
+	TMap<FName, FRgbPoseSequenceWindow> SubjectSequences;
+	FThreadSafeCounter FramesAccepted;
+	FThreadSafeCounter FramesLost;
+	FThreadSafeCounter LateFramesDropped;
+	FThreadSafeCounter DuplicateFramesDropped;
+	FThreadSafeCounter DeltasWithoutKeyframe;
+
+	// Messages too large for one datagram, waiting for the rest of their fragments
+	FRgbPoseFragmentAssembler FragmentAssembler;
+
+	// Datagrams received by the socket thread, waiting for the game thread
+	FRgbPoseDatagramRing DatagramRing;
+
+	// The sender's clock is unrelated to ours, the offset between them is the smallest receive minus send time seen over
+	// the current and the previous window. The fastest frame of those windows therefore reads 0 ms, even on one machine,
+	// and every latency is how much later than that frame a frame arrived.
+	double ClockOffsetWindowStart = 0.0;
+	double CurrentWindowClockOffset;
+	double PreviousWindowClockOffset;
 
 	// Check if static data is setup
 
@@ -101,7 +216,20 @@ private:
 	void AddAnimFrameData(FVector* inVector, FLiveLinkAnimationFrameData& animFrameData);
 	void AddAnimFrameData(FQuat* inQuat, FLiveLinkAnimationFrameData& animFrameData);
 
-	void AddStaticSkeletonData(FName subjectName, TMap<FString, FTransform> BoneName_TransformMap);
+	void AddStaticSkeletonData(FName subjectName, const TArray<FName>& BoneNames);
+
+	void AddStaticTransformData(FName subjectName);
+
+	bool EnsureSubject(FName SubjectName, TSubclassOf<ULiveLinkRole> Role);
+	void PushSkeletonFrame(FName SubjectName, const TArray<FName>& BoneNames, const TArray<FTransform>& Transforms, const FRgbPoseFrameTiming& Timing);
+	void PushTransformFrame(FName SubjectName, const FTransform& Transform, const FRgbPoseFrameTiming& Timing);
+
+	bool AcceptSequence(FName SubjectName, uint32 Sequence);
+
+	void ConvertBinaryPose(const FRgbPosePacketHeader& Header);
+
+	FRgbPoseFrameTiming MakeFrameTiming(uint64 SendTimeMicros, double ReceiveTime, double ParseTime);
+	void RecordLatency(FName SubjectName, const FRgbPoseFrameTiming& Timing);
 
 	void CreateJoint(TArray<FTransform>& transforms, bool hasParent, FTransform ParentTransform, FVector ParentPosition, FVector PointPosition);
 };
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "LiveLinkSourceSettings.h"
+#include "RgbPoseLiveLinkSourceSettings.generated.h"
+
+UCLASS()
+class URgbPoseLiveLinkSourceSettings : public ULiveLinkSourceSettings
+{
+public:
+
+	GENERATED_BODY()
+
+	// Datagrams buffered between the UDP thread and the game thread, the oldest is dropped when it is full. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive", meta = (ClampMin = 2, ClampMax = 4096))
+	int32 RingBufferDepth = 64;
+
+	// Largest datagram accepted in bytes, bigger ones are dropped. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive", meta = (ClampMin = 512, ClampMax = 65507))
+	int32 MaxDatagramSize = 65507;
+
+	// Parse and push poses on the UDP thread instead of the game thread, so editor hitches do not delay them. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive")
+	bool bDecodeOnReceiveThread = false;
+
+	// Decode only the newest pose per subject out of each batch of received datagrams, skipping the stale ones. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive")
+	bool bCoalesceFrames = false;
+
+	// Longest the UDP thread sleeps waiting for data, it wakes as soon as a datagram arrives. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive", meta = (ClampMin = 0.1, ClampMax = 1000, Units = "ms"))
+	float WaitTimeMs = 10.0f;
+
+	// Poll the socket in a loop instead of sleeping, trading a CPU core for the wakeup latency. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive")
+	bool bBusyPoll = false;
+
+	// Datagrams drained from the socket per wakeup before coalesced frames are flushed. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive", meta = (ClampMin = 1, ClampMax = 4096))
+	int32 MaxDatagramsPerWakeup = 64;
+
+	// Longest a message split into fragments waits for its missing chunks before it is dropped. Applied when the source is created
+	UPROPERTY(EditAnywhere, Category = "Receive", meta = (ClampMin = 1, ClampMax = 10000, Units = "ms"))
+	float FragmentTimeoutMs = 250.0f;
+};
@@ -0,0 +1,218 @@
+﻿#include "RgbPoseProtocol.h"
+
+#include "RgbPoseBuffer.h"
+
+namespace RgbPoseProtocol
+{
+	// Version 1 headers end right before the send time
+	static const int32 MinHeaderSize = STRUCT_OFFSET(FRgbPosePacketHeader, SendTimeMicros);
+
+	static bool ReadName(const uint8*& Cursor, const uint8* End, FName& OutName)
+	{
+		if (Cursor >= End)
+		{
+			return false;
+		}
+		const int32 Length = *Cursor++;
+		if (Cursor + Length > End)
+		{
+			return false;
+		}
+		FUTF8ToTCHAR Converted(reinterpret_cast<const ANSICHAR*>(Cursor), Length);
+		OutName = FName(Converted.Length(), Converted.Get());
+		Cursor += Length;
+		return true;
+	}
+
+	static float ReadQuantised(const uint8*& Cursor, float Quantum)
+	{
+		int16 Value;
+		FMemory::Memcpy(&Value, Cursor, sizeof(int16));
+		Cursor += sizeof(int16);
+		return Value * Quantum;
+	}
+}
+
+bool RgbPoseProtocol::IsBinaryPacket(const uint8* Data, int32 Num)
+{
+	uint32 Magic = 0;
+	if (Num < (int32)sizeof(Magic))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&Magic, Data, sizeof(Magic));
+	return Magic == PacketMagic;
+}
+
+bool RgbPoseProtocol::ReadHeader(const uint8* Data, int32 Num, FRgbPosePacketHeader& OutHeader, const uint8*& OutPayload)
+{
+	if (Num < MinHeaderSize)
+	{
+		return false;
+	}
+	FMemory::Memzero(OutHeader);
+	FMemory::Memcpy(&OutHeader, Data, MinHeaderSize);
+	if (OutHeader.Magic != PacketMagic || OutHeader.Version == 0 || OutHeader.Version > ProtocolVersion)
+	{
+		return false;
+	}
+	if (OutHeader.HeaderSize < MinHeaderSize || (int64)OutHeader.HeaderSize + OutHeader.PayloadSize > Num)
+	{
+		return false;
+	}
+	// Fields older senders do not write stay zero
+	FMemory::Memcpy(&OutHeader, Data, FMath::Min<int32>(OutHeader.HeaderSize, sizeof(FRgbPosePacketHeader)));
+	OutPayload = Data + OutHeader.HeaderSize;
+	return true;
+}
+
+bool RgbPoseProtocol::ReadSkeleton(const FRgbPosePacketHeader& Header, const uint8* Payload, FName& OutSubjectName, TArray<FName>& OutBoneNames, TArray<int32>& OutBoneParents)
+{
+	const uint8* Cursor = Payload;
+	const uint8* End = Payload + Header.PayloadSize;
+
+	if (!ReadName(Cursor, End, OutSubjectName))
+	{
+		return false;
+	}
+
+	OutBoneNames.Reset(Header.BoneCount);
+	for (int32 BoneIndex = 0; BoneIndex < Header.BoneCount; BoneIndex++)
+	{
+		FName BoneName;
+		if (!ReadName(Cursor, End, BoneName))
+		{
+			return false;
+		}
+		OutBoneNames.Add(BoneName);
+	}
+
+	OutBoneParents.Reset();
+	if ((Header.Flags & ERgbPosePacketFlags::Hierarchy) != 0)
+	{
+		if (Cursor + Header.BoneCount * sizeof(int16) > End)
+		{
+			return false;
+		}
+		OutBoneParents.AddUninitialized(Header.BoneCount);
+		for (int32 BoneIndex = 0; BoneIndex < Header.BoneCount; BoneIndex++)
+		{
+			int16 Parent;
+			FMemory::Memcpy(&Parent, Cursor, sizeof(int16));
+			Cursor += sizeof(int16);
+			OutBoneParents[BoneIndex] = Parent;
+		}
+	}
+	return true;
+}
+
+bool RgbPoseProtocol::ReadPose(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseBuffer& OutPose)
+{
+	const int32 BoneCount = Header.BoneCount;
+	if ((Header.Flags & ERgbPosePacketFlags::Packed) != 0)
+	{
+		if (sizeof(float) + (int64)BoneCount * (3 * sizeof(int16) + sizeof(uint32)) > Header.PayloadSize)
+		{
+			return false;
+		}
+		float PositionScale;
+		FMemory::Memcpy(&PositionScale, Payload, sizeof(float));
+		const uint8* Positions = Payload + sizeof(float);
+		OutPose.SetNum(BoneCount);
+		OutPose.UnpackPacked(Positions, PositionScale, Positions + BoneCount * 3 * sizeof(int16));
+		return true;
+	}
+
+	const bool bHalfPrecision = (Header.Flags & ERgbPosePacketFlags::HalfPrecision) != 0;
+	const int32 ComponentSize = bHalfPrecision ? sizeof(uint16) : sizeof(float);
+	if ((int64)BoneCount * 7 * ComponentSize > Header.PayloadSize)
+	{
+		return false;
+	}
+
+	OutPose.SetNum(BoneCount);
+	const uint8* Rotations = Payload + BoneCount * 3 * ComponentSize;
+	if (bHalfPrecision)
+	{
+		OutPose.UnpackHalfs(Payload, Rotations);
+	}
+	else
+	{
+		OutPose.UnpackFloats(Payload, Rotations);
+	}
+	return true;
+}
+
+bool RgbPoseProtocol::ReadDeltaHeader(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseDeltaHeader& OutDeltaHeader)
+{
+	if (Header.PayloadSize < sizeof(FRgbPoseDeltaHeader))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&OutDeltaHeader, Payload, sizeof(FRgbPoseDeltaHeader));
+	return true;
+}
+
+bool RgbPoseProtocol::ReadPoseDelta(const FRgbPosePacketHeader& Header, const uint8* Payload, const FRgbPoseDeltaHeader& DeltaHeader, const FRgbPoseBuffer& Keyframe, FRgbPoseBuffer& OutPose)
+{
+	const int32 NumChanged = DeltaHeader.NumChangedBones;
+	const int64 ChangedSize = (int64)NumChanged * (sizeof(uint16) + 7 * sizeof(int16));
+	if (sizeof(FRgbPoseDeltaHeader) + ChangedSize > Header.PayloadSize || Keyframe.Num() != Header.BoneCount)
+	{
+		return false;
+	}
+
+	OutPose = Keyframe;
+
+	///		CHANGED BONES ARE SCATTERED INTO THE COMPONENT ARRAYS, ROTATIONS ARE NORMALISED WITH THE REST OF THE POSE LATER
+	const uint8* Indices = Payload + sizeof(FRgbPoseDeltaHeader);
+	const uint8* Positions = Indices + NumChanged * sizeof(uint16);
+	const uint8* Rotations = Positions + NumChanged * 3 * sizeof(int16);
+	for (int32 ChangedIndex = 0; ChangedIndex < NumChanged; ChangedIndex++)
+	{
+		uint16 BoneIndex;
+		FMemory::Memcpy(&BoneIndex, Indices, sizeof(uint16));
+		Indices += sizeof(uint16);
+		if (BoneIndex >= Header.BoneCount)
+		{
+			return false;
+		}
+
+		for (int32 Component = FRgbPoseBuffer::X; Component <= FRgbPoseBuffer::Z; Component++)
+		{
+			OutPose.GetComponent(Component)[BoneIndex] += ReadQuantised(Positions, DeltaHeader.PositionQuantum);
+		}
+		for (int32 Component = FRgbPoseBuffer::QX; Component <= FRgbPoseBuffer::QW; Component++)
+		{
+			OutPose.GetComponent(Component)[BoneIndex] = ReadQuantised(Rotations, RotationQuantum);
+		}
+	}
+	return true;
+}
+
+bool RgbPoseProtocol::ReadFragment(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseFragmentHeader& OutFragmentHeader, const uint8*& OutChunk, int32& OutChunkSize)
+{
+	if (Header.PayloadSize < sizeof(FRgbPoseFragmentHeader))
+	{
+		return false;
+	}
+	FMemory::Memcpy(&OutFragmentHeader, Payload, sizeof(FRgbPoseFragmentHeader));
+	OutChunk = Payload + sizeof(FRgbPoseFragmentHeader);
+	OutChunkSize = Header.PayloadSize - sizeof(FRgbPoseFragmentHeader);
+	const FRgbPoseFragmentHeader& Fragment = OutFragmentHeader;
+	return Fragment.ChunkIndex < Fragment.ChunkCount && (int64)Fragment.ChunkOffset + OutChunkSize <= Fragment.MessageSize;
+}
+
+const FRgbPoseSpaceConversion& RgbPoseProtocol::GetBlenderSpaceConversion()
+{
+	///		BLENDER METRES TO CENTIMETRES, AND THE X AND Z ROTATION FLIPS THE TEXT SENDER APPLIES PER BONE
+	static const FRgbPoseSpaceConversion Conversion = []()
+	{
+		FRgbPoseSpaceConversion Result;
+		Result.PositionScale = 100.0f;
+		Result.RotationSigns[0] = -1.0f;
+		Result.RotationSigns[2] = -1.0f;
+		return Result;
+	}();
+	return Conversion;
+}
@@ -0,0 +1,140 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+class FRgbPoseBuffer;
+struct FRgbPoseSpaceConversion;
+
+/**
+ * Binary wire format shared with BlenderAddOn/BlenderPy.py.
+ *
+ * Every binary datagram starts with FRgbPosePacketHeader. Text datagrams start with "S_", "A_", "O_" or "H_", so the
+ * receiver tells both formats apart from the first four bytes and each sender is free to pick either one.
+ * Senders stamp every pose with a per subject sequence number and their monotonic clock, in the header (the clock from
+ * version 2 on) and in an "S_=Sequence,SendTimeMicros||" entry in front of each subject of a text datagram. The
+ * receiver drops late and duplicated frames and measures end-to-end latency with them.
+ * All fields are little-endian and tightly packed. A datagram may hold several packets back to back, for example the
+ * pose packets of every subject of a frame.
+ *
+ * Skeleton packet : header, subject name, then BoneCount bone names (each one a uint8 length followed by UTF-8 bytes),
+ *                   then BoneCount int16 parent indices (-1 for roots) when ERgbPosePacketFlags::Hierarchy is set
+ * Pose packet     : header, BoneCount * 3 position components (x,y,z), then BoneCount * 4 rotation components (x,y,z,w),
+ *                   stored as float32, or as float16 when ERgbPosePacketFlags::HalfPrecision is set
+ * Packed pose     : with ERgbPosePacketFlags::Packed, header, float32 position scale of the skeleton, BoneCount * 3 int16
+ *                   positions in scale units, then BoneCount uint32 smallest-three rotations: the index of the largest
+ *                   component in the top 2 bits and the other three, in x,y,z,w order, as 10 bits each over
+ *                   [-1/sqrt(2), 1/sqrt(2)]. The largest component is rebuilt as positive.
+ * Delta packet    : header, FRgbPoseDeltaHeader, then NumChangedBones uint16 bone indices, NumChangedBones * 3 int16
+ *                   position offsets from the keyframe in PositionQuantum units, NumChangedBones * 4 int16 rotation
+ *                   components in RotationQuantum units. Bones not listed keep their keyframe transform.
+ *
+ * Pose and delta packets flagged ERgbPosePacketFlags::BlenderSpace carry Blender's local bone values as they are, positions
+ * in metres and rotations unflipped, and the receiver converts them in bulk. Unflagged ones are already converted.
+ *
+ * A pose packet flagged ERgbPosePacketFlags::Keyframe is the full frame the following delta packets of its subject are
+ * relative to. Deltas never build on each other, so losing one does not affect the next.
+ *
+ * Fragment packet : header, FRgbPoseFragmentHeader, then the chunk's bytes. A message, text or binary, that would not fit
+ *                   in one safe sized datagram is split into chunks that each go in a datagram of their own. Once every
+ *                   chunk of a MessageId has arrived the message is handled as if it had been received whole.
+ */
+namespace RgbPoseProtocol
+{
+	// "RGBP" read as a little-endian uint32
+	static const uint32 PacketMagic = 0x50424752;
+
+	static const uint8 ProtocolVersion = 2;
+
+	// Rotation components of delta packets are int16 over [-1, 1]
+	static const float RotationQuantum = 1.0f / 32767.0f;
+}
+
+enum class ERgbPosePacketType : uint8
+{
+	Skeleton = 1,
+	Pose = 2,
+	PoseDelta = 3,
+	Fragment = 4,
+};
+
+namespace ERgbPosePacketFlags
+{
+	enum Type : uint8
+	{
+		None = 0,
+		HalfPrecision = 1 << 0,
+		Hierarchy = 1 << 1,
+		Keyframe = 1 << 2,
+		Packed = 1 << 3,
+		BlenderSpace = 1 << 4,
+	};
+}
+
+#pragma pack(push, 1)
+struct FRgbPosePacketHeader
+{
+	uint32 Magic;
+	uint8 Version;
+	// Size of this header on the wire, lets newer senders append fields older receivers skip over
+	uint8 HeaderSize;
+	uint8 PacketType;
+	uint8 Flags;
+	// CRC32 of the UTF-8 subject name, announced by the skeleton packet
+	uint32 SubjectId;
+	// Sequence number of the subject's poses, counted up by one per pose sent
+	uint32 FrameNumber;
+	uint16 BoneCount;
+	// Number of bytes following the header
+	uint32 PayloadSize;
+	// Sender's monotonic clock in microseconds when the frame was sampled, 0 for version 1 senders
+	uint64 SendTimeMicros;
+};
+
+struct FRgbPoseDeltaHeader
+{
+	// Sequence number of the keyframe the bones are relative to
+	uint32 KeyframeSequence;
+	// Size of one step of the quantised position offsets
+	float PositionQuantum;
+	uint16 NumChangedBones;
+};
+
+struct FRgbPoseFragmentHeader
+{
+	// Counted up by the sender per fragmented message
+	uint32 MessageId;
+	// Size of the whole message
+	uint32 MessageSize;
+	// Where the chunk's bytes go in the message
+	uint32 ChunkOffset;
+	uint16 ChunkIndex;
+	uint16 ChunkCount;
+};
+#pragma pack(pop)
+
+namespace RgbPoseProtocol
+{
+	/** True if the datagram starts with the binary packet magic */
+	bool IsBinaryPacket(const uint8* Data, int32 Num);
+
+	/** Validates and reads the header, OutPayload points right after it */
+	bool ReadHeader(const uint8* Data, int32 Num, FRgbPosePacketHeader& OutHeader, const uint8*& OutPayload);
+
+	/** Reads the subject name, bone names and, when present, parent indices of a skeleton packet */
+	bool ReadSkeleton(const FRgbPosePacketHeader& Header, const uint8* Payload, FName& OutSubjectName, TArray<FName>& OutBoneNames, TArray<int32>& OutBoneParents);
+
+	/** Reads the bone components of a pose packet, as they were sent */
+	bool ReadPose(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseBuffer& OutPose);
+
+	/** Reads the part of a delta packet that says which keyframe it needs */
+	bool ReadDeltaHeader(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseDeltaHeader& OutDeltaHeader);
+
+	/** Rebuilds the full pose of a delta packet from the keyframe it was encoded against, both in the sender's space */
+	bool ReadPoseDelta(const FRgbPosePacketHeader& Header, const uint8* Payload, const FRgbPoseDeltaHeader& DeltaHeader, const FRgbPoseBuffer& Keyframe, FRgbPoseBuffer& OutPose);
+
+	/** Reads the header of a fragment packet, OutChunk points at the chunk's OutChunkSize bytes */
+	bool ReadFragment(const FRgbPosePacketHeader& Header, const uint8* Payload, FRgbPoseFragmentHeader& OutFragmentHeader, const uint8*& OutChunk, int32& OutChunkSize);
+
+	/** Takes poses flagged ERgbPosePacketFlags::BlenderSpace into the space the text protocol sends */
+	const FRgbPoseSpaceConversion& GetBlenderSpaceConversion();
+}
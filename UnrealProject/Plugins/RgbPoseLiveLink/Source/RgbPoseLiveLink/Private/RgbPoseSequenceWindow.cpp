@@ -0,0 +1,64 @@
+﻿#include "RgbPoseSequenceWindow.h"
+
+namespace RgbPoseSequence
+{
+	static const int32 WindowSize = 64;
+
+	// A sender restarted shortly after its previous start jumps back less than the window, reordering never holds back
+	// this many frames in a row
+	static const int32 RestartAfterStale = 16;
+}
+
+void FRgbPoseSequenceWindow::Restart(uint32 Sequence)
+{
+	First = Sequence;
+	Highest = Sequence;
+	ReceivedMask = 1;
+	NumStaleInARow = 0;
+	bStarted = true;
+}
+
+ERgbPoseSequenceResult FRgbPoseSequenceWindow::Add(uint32 Sequence, int32& OutLostChange)
+{
+	using namespace RgbPoseSequence;
+
+	OutLostChange = 0;
+	if (!bStarted)
+	{
+		Restart(Sequence);
+		return ERgbPoseSequenceResult::Newer;
+	}
+
+	// Wrapping difference, so the count can roll over
+	const int32 Distance = (int32)(Sequence - Highest);
+	if (Distance > 0)
+	{
+		OutLostChange = Distance - 1;
+		ReceivedMask = Distance < WindowSize ? (ReceivedMask << Distance) | 1 : 1;
+		Highest = Sequence;
+		NumStaleInARow = 0;
+		return ERgbPoseSequenceResult::Newer;
+	}
+
+	///		NOTHING OLDER THAN THE WINDOW IS REORDERING, THE SENDER STARTED COUNTING AGAIN AND ITS FIRST FRAME IS KEPT
+	const uint32 Age = Highest - Sequence;
+	if (Age >= (uint32)WindowSize || ++NumStaleInARow >= RestartAfterStale)
+	{
+		Restart(Sequence);
+		return ERgbPoseSequenceResult::Newer;
+	}
+
+	if ((int32)(Sequence - First) < 0)
+	{
+		// From before the window started, it was never counted lost
+		return ERgbPoseSequenceResult::Late;
+	}
+	const uint64 Bit = 1ull << Age;
+	if ((ReceivedMask & Bit) != 0)
+	{
+		return ERgbPoseSequenceResult::Duplicate;
+	}
+	ReceivedMask |= Bit;
+	OutLostChange = -1;
+	return ERgbPoseSequenceResult::Late;
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+enum class ERgbPoseSequenceResult : uint8
+{
+	// Newer than every frame of the subject so far
+	Newer,
+	// Older than the newest frame, arrived out of order
+	Late,
+	// Already received
+	Duplicate,
+};
+
+/**
+ * Remembers which of a subject's last 64 sequence numbers arrived, to tell late and duplicated frames apart and count the
+ * frames that never arrived. A frame older than the window, or a run of stale frames, means the sender restarted its count,
+ * and the window starts over.
+ */
+class FRgbPoseSequenceWindow
+{
+public:
+	/** Classifies the frame, OutLostChange is the number of frames it shows lost, or -1 when it fills an earlier gap */
+	ERgbPoseSequenceResult Add(uint32 Sequence, int32& OutLostChange);
+
+private:
+	void Restart(uint32 Sequence);
+
+	// First sequence number since the window started, nothing before it was counted lost
+	uint32 First = 0;
+	// Newest sequence number received
+	uint32 Highest = 0;
+	// Bit N is set when Highest - N was received
+	uint64 ReceivedMask = 0;
+	// Late or duplicated frames since the last newer one
+	int32 NumStaleInARow = 0;
+	bool bStarted = false;
+};
@@ -0,0 +1,178 @@
+﻿#include "Misc/AutomationTest.h"
+#include "PoseFrame.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace PoseFrameTests
+{
+	// Datagrams as the add-on sent them, from before the in-place parser (unstamped armatures, objects written with
+	// Python's str()) and from the current sender (stamps, hierarchies, several subjects in one datagram)
+	static const ANSICHAR* CapturedDatagrams[] =
+	{
+		"A_Armature=Hips:(-52.850170550,-104.745247823,45.280341912,-0.865163689,0.423409936,0.178585222,0.200806215)|Spine:(2.230719957,-138.751302467,-19.906294901,-0.205302896,0.096380513,0.866448255,0.444779652)|Spine1:(-112.859411655,-83.028310618,38.229966722,-0.409360260,-0.139555198,0.718227803,0.545066369)|Neck:(-136.025195815,107.540537715,-63.117214100,-0.161856263,0.206659280,0.346641168,0.900518958)|Head:(-95.782086023,24.480049099,41.674040678,0.669991184,0.692268460,-0.247502969,0.103045973)|LeftArm:(-88.212386154,54.119991955,-21.722308299,0.330952558,0.776170867,0.513632183,0.155599388)|LeftForeArm:(88.313844457,59.698330119,-76.771046783,0.537788144,-0.271568407,-0.564860688,-0.563885552)|LeftHand:(-63.618670533,144.052454248,-114.580266524,0.716972565,0.405243631,-0.327650391,0.463004495)|RightArm:(-138.237822886,50.464756960,79.371259864,0.715436206,-0.353424966,0.234998978,0.554993071)|RightForeArm:(28.310963132,23.968561285,-13.138400610,-0.456487425,-0.719631055,0.516298007,0.084774661)|RightHand:(-131.799171721,60.447606391,44.138656358,-0.882200230,-0.038293420,0.101213552,0.458270865)||",
+		"H_Rig=-1,0,1||S_=41,1002429832||A_Rig=Hips:(50.595814765,-143.231121583,-11.491414110,-0.137973905,0.243842395,-0.894841267,0.347509993)|Spine:(-111.197933394,-75.715549891,-32.715089060,-0.213362062,-0.223177742,0.903075961,0.298533306)|Spine1:(115.015147932,95.783951351,109.195340910,0.079301082,0.439347178,0.565033234,0.693846410)|Neck:(137.319361189,-104.723728263,-97.134681453,-0.054254980,0.476520521,0.873573975,0.082783452)|Head:(-71.176014210,-148.771918984,-24.316049662,0.439324239,0.472251791,-0.731237787,-0.221954405)||S_=7,1002429840||A_Rig.001=LeftArm:(4.647429921,35.277824823,52.860024735,-0.683547343,0.241217212,-0.128956461,-0.676718197)|LeftForeArm:(89.361936359,-32.286327933,-30.306350304,-0.769532742,0.585661479,-0.235371691,0.097057503)|LeftHand:(-87.371044366,-101.309043668,-47.983904330,-0.044124833,0.015130729,-0.580704026,0.812777272)|RightArm:(-40.917023390,-142.349734000,112.299713212,0.394437649,-0.343663817,0.012089398,0.852154897)|RightForeArm:(-40.750968142,-113.147330771,104.681077945,-0.934419733,-0.040520204,0.352037653,0.035879880)|RightHand:(-119.343714976,-47.209248527,-70.572932485,-0.111666471,-0.206626792,-0.961810077,0.140560820)||",
+		"S_=12,1002430001||O_Cube=(28.257395042,-353.397461101,43.172425882,0.515888422,0.088509555,0.844309153,-0.114748633)||",
+		"O_Cube=(1.0,-3.0517578125e-05,2.0000000000000004,-0.26186955491633584,-0.7448985373634682,-0.41069827615910554,0.45593577530352347)||",
+		"O_Cube=(0.0,0.0,0.0,-0.0,0.0,-0.0,1.0)||O_Light=(407.6245307922363,100.54539442062378,590.3861999511719,0.16907575726509094,0.7558803558349609,-0.27217137813568115,0.570947527885437)||",
+	};
+
+	// Numbers ParseFloat reads itself and those it hands to Atof: signs, whitespace, more digits than a double holds,
+	// more than 22 decimals, exponents and things that are not numbers
+	static const ANSICHAR* FloatEdgeCases[] =
+	{
+		"0", "-0.0", "+1.5", " 3.25", "1.", ".5", "-100.000000000", "0.000000001", "123456789.123456789",
+		"9007199254740992", "9007199254740993", "12345678901234567890", "0.1000000000000000055511151231257827",
+		"0.12345678901234567890123", "-0.123456789012345678901234567", "1e5", "-2.5E-3", "-3.0517578125e-05",
+		"2.0000000000000004", "3.4028235e38", "1e-50", "inf", "-", "",
+	};
+
+	/** The split and Atof path PoseFrame took before it parsed in place, kept as the reference */
+	static FTransform LegacyConvertToTransform(FString TransformText)
+	{
+		TransformText = TransformText.RightChop(1);
+		TransformText = TransformText.LeftChop(1);
+		TArray<FString> Elements;
+		TransformText.ParseIntoArray(Elements, TEXT(","), false);
+		const float X = FCString::Atof(*Elements[0]);
+		const float Y = FCString::Atof(*Elements[1]);
+		const float Z = FCString::Atof(*Elements[2]);
+		const float RX = FCString::Atof(*Elements[3]);
+		const float RY = FCString::Atof(*Elements[4]);
+		const float RZ = FCString::Atof(*Elements[5]);
+		const float RW = FCString::Atof(*Elements[6]);
+		return FTransform(FQuat(RX, RY, RZ, RW), FVector(X, Y, Z));
+	}
+
+	static void LegacyParse(const ANSICHAR* Datagram, TArray<FString>& OutNames, TArray<FTransform>& OutTransforms)
+	{
+		FString Received;
+		for (const ANSICHAR* Char = Datagram; *Char != 0; Char++)
+		{
+			Received += TCHAR(uint8(*Char));
+		}
+		TArray<FString> Entries;
+		Received.ParseIntoArray(Entries, TEXT("||"), false);
+		for (const FString& Entry : Entries)
+		{
+			if (Entry.IsEmpty()) break;
+			TArray<FString> KeyValue;
+			Entry.ParseIntoArray(KeyValue, TEXT("="), false);
+			if (KeyValue[0].StartsWith(TEXT("O_"), ESearchCase::CaseSensitive))
+			{
+				OutNames.Add(KeyValue[0].RightChop(2));
+				OutTransforms.Add(LegacyConvertToTransform(KeyValue[1]));
+			}
+			else if (KeyValue[0].StartsWith(TEXT("A_"), ESearchCase::CaseSensitive))
+			{
+				TArray<FString> Bones;
+				KeyValue[1].ParseIntoArray(Bones, TEXT("|"), false);
+				for (const FString& Bone : Bones)
+				{
+					TArray<FString> BoneNameTransform;
+					Bone.ParseIntoArray(BoneNameTransform, TEXT(":"), false);
+					OutNames.Add(BoneNameTransform[0]);
+					OutTransforms.Add(LegacyConvertToTransform(BoneNameTransform[1]));
+				}
+			}
+		}
+	}
+
+	static bool IsBitIdentical(float A, float B)
+	{
+		return FMemory::Memcmp(&A, &B, sizeof(float)) == 0;
+	}
+
+	static bool IsBitIdentical(const FTransform& A, const FTransform& B)
+	{
+		const FVector TranslationA = A.GetTranslation();
+		const FVector TranslationB = B.GetTranslation();
+		const FQuat RotationA = A.GetRotation();
+		const FQuat RotationB = B.GetRotation();
+		return IsBitIdentical(TranslationA.X, TranslationB.X) && IsBitIdentical(TranslationA.Y, TranslationB.Y) && IsBitIdentical(TranslationA.Z, TranslationB.Z)
+			&& IsBitIdentical(RotationA.X, RotationB.X) && IsBitIdentical(RotationA.Y, RotationB.Y) && IsBitIdentical(RotationA.Z, RotationB.Z) && IsBitIdentical(RotationA.W, RotationB.W);
+	}
+
+	static float Atof(const ANSICHAR* Text)
+	{
+		return FCString::Atof(ANSI_TO_TCHAR(Text));
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPoseFrameMatchesLegacyParserTest, "RgbPoseLiveLink.PoseFrame.MatchesLegacyParser",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FPoseFrameMatchesLegacyParserTest::RunTest(const FString& Parameters)
+{
+	using namespace PoseFrameTests;
+
+	PoseFrame Frame;
+	for (const ANSICHAR* Datagram : CapturedDatagrams)
+	{
+		TArray<FString> ExpectedNames;
+		TArray<FTransform> ExpectedTransforms;
+		LegacyParse(Datagram, ExpectedNames, ExpectedTransforms);
+
+		///		SUBJECTS AND OBJECTS IN THE ORDER THEY WERE SENT, AS THE LEGACY PATH LISTED THEM
+		TestTrue(TEXT("Datagram parsed"), Frame.ParseText(reinterpret_cast<const uint8*>(Datagram), FCStringAnsi::Strlen(Datagram)));
+		TArray<FString> Names;
+		TArray<FTransform> Transforms;
+		for (int32 Subject = 0; Subject < Frame.NumSubjects; Subject++)
+		{
+			for (int32 Bone = 0; Bone < Frame.Subjects[Subject].BoneNames.Num(); Bone++)
+			{
+				Names.Add(Frame.Subjects[Subject].BoneNames[Bone].ToString());
+				Transforms.Add(Frame.Subjects[Subject].BoneTransforms[Bone]);
+			}
+		}
+		for (int32 Object = 0; Object < Frame.ObjectNames.Num(); Object++)
+		{
+			Names.Add(Frame.ObjectNames[Object].ToString());
+			Transforms.Add(Frame.ObjectTransforms[Object]);
+		}
+
+		if (!TestEqual(TEXT("Number of transforms"), Transforms.Num(), ExpectedTransforms.Num()))
+		{
+			continue;
+		}
+		for (int32 Index = 0; Index < Transforms.Num(); Index++)
+		{
+			TestEqual(TEXT("Name"), Names[Index], ExpectedNames[Index]);
+			TestTrue(FString::Printf(TEXT("%s is bit identical to the legacy parse"), *ExpectedNames[Index]), IsBitIdentical(Transforms[Index], ExpectedTransforms[Index]));
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPoseFrameParseFloatTest, "RgbPoseLiveLink.PoseFrame.ParseFloat",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FPoseFrameParseFloatTest::RunTest(const FString& Parameters)
+{
+	using namespace PoseFrameTests;
+
+	for (const ANSICHAR* Text : FloatEdgeCases)
+	{
+		const float Parsed = PoseFrame::ParseFloat(Text, Text + FCStringAnsi::Strlen(Text));
+		TestTrue(FString::Printf(TEXT("\"%s\" reads as Atof does"), ANSI_TO_TCHAR(Text)), IsBitIdentical(Parsed, Atof(Text)));
+	}
+
+	///		THE FORMATS SENDERS USE, OVER THE RANGE OF CENTIMETRE POSITIONS AND QUATERNION COMPONENTS
+	FRandomStream Random(7);
+	static const int32 DecimalCounts[] = { 0, 1, 6, 9, 15, 17, 22 };
+	for (int32 Sample = 0; Sample < 20000; Sample++)
+	{
+		const double Value = Random.FRandRange(-1000.0f, 1000.0f) * (Sample % 2 == 0 ? 1.0 : 0.001);
+		const int32 Decimals = DecimalCounts[Sample % UE_ARRAY_COUNT(DecimalCounts)];
+		const FString Formatted = FString::Printf(TEXT("%.*f"), Decimals, Value);
+		ANSICHAR Text[64];
+		FCStringAnsi::Strncpy(Text, TCHAR_TO_ANSI(*Formatted), UE_ARRAY_COUNT(Text));
+		const float Parsed = PoseFrame::ParseFloat(Text, Text + FCStringAnsi::Strlen(Text));
+		if (!IsBitIdentical(Parsed, Atof(Text)))
+		{
+			AddError(FString::Printf(TEXT("\"%s\" reads differently from Atof"), *Formatted));
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,194 @@
+﻿#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+#include "RgbPoseBuffer.h"
+#include "RgbPoseProtocol.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RgbPoseBufferTests
+{
+	// Every size up to three blocks of four, and one past a whole block of the packed position decode
+	static const int32 BoneCounts[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 70 };
+
+	static bool IsBitIdentical(float A, float B)
+	{
+		return FMemory::Memcmp(&A, &B, sizeof(float)) == 0;
+	}
+
+	/** Positions and rotations interleaved as they are sent, random values with a few of each sign */
+	static void MakeInterleaved(FRandomStream& Random, int32 NumBones, TArray<float>& OutPositions, TArray<float>& OutRotations)
+	{
+		OutPositions.SetNumUninitialized(NumBones * 3);
+		OutRotations.SetNumUninitialized(NumBones * 4);
+		for (float& Value : OutPositions)
+		{
+			Value = Random.FRandRange(-200.0f, 200.0f);
+		}
+		for (float& Value : OutRotations)
+		{
+			Value = Random.FRandRange(-1.0f, 1.0f);
+		}
+	}
+
+	/** True when every bone of the pose holds the interleaved values, bit for bit */
+	static bool MatchesInterleaved(const FRgbPoseBuffer& Pose, const TArray<float>& Positions, const TArray<float>& Rotations)
+	{
+		for (int32 Bone = 0; Bone < Pose.Num(); Bone++)
+		{
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				if (!IsBitIdentical(Pose.GetComponent(FRgbPoseBuffer::X + Axis)[Bone], Positions[Bone * 3 + Axis]))
+				{
+					return false;
+				}
+			}
+			for (int32 Component = 0; Component < 4; Component++)
+			{
+				if (!IsBitIdentical(Pose.GetComponent(FRgbPoseBuffer::QX + Component)[Bone], Rotations[Bone * 4 + Component]))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/** Padding past the last bone stays a zero position and an identity rotation, w flipped or not, so kernels may run over it */
+	static bool IsPaddingIdentity(const FRgbPoseBuffer& Pose)
+	{
+		for (int32 Bone = Pose.Num(); Bone < Align(Pose.Num(), 4); Bone++)
+		{
+			for (int32 Component = FRgbPoseBuffer::X; Component < FRgbPoseBuffer::NumComponents; Component++)
+			{
+				if (FMath::Abs(Pose.GetComponent(Component)[Bone]) != (Component == FRgbPoseBuffer::QW ? 1.0f : 0.0f))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseBufferUnpackTest, "RgbPoseLiveLink.PoseBuffer.Unpack",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseBufferUnpackTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseBufferTests;
+
+	FRandomStream Random(20);
+	FRgbPoseBuffer Pose;
+	for (int32 NumBones : BoneCounts)
+	{
+		///		FLOAT32 COMPONENTS ARE ONLY MOVED, THE VECTOR TRANSPOSE MUST KEEP EVERY BIT
+		TArray<float> Positions;
+		TArray<float> Rotations;
+		MakeInterleaved(Random, NumBones, Positions, Rotations);
+		Pose.SetNum(NumBones);
+		Pose.UnpackFloats(reinterpret_cast<const uint8*>(Positions.GetData()), reinterpret_cast<const uint8*>(Rotations.GetData()));
+		TestTrue(FString::Printf(TEXT("%d float bones deinterleave"), NumBones), MatchesInterleaved(Pose, Positions, Rotations));
+		TestTrue(FString::Printf(TEXT("%d float bones keep their padding"), NumBones), IsPaddingIdentity(Pose));
+
+		///		INT16 POSITIONS ARE SIGN EXTENDED AND SCALED WITH ONE MULTIPLY, AS THE SCALAR TAIL DOES
+		static const float PositionScale = 0.0061f;
+		TArray<int16> Steps;
+		Steps.SetNumUninitialized(NumBones * 3);
+		for (int32 Index = 0; Index < Steps.Num(); Index++)
+		{
+			Steps[Index] = Index % 7 == 0 ? (Index % 2 == 0 ? 32767 : -32767) : (int16)Random.RandRange(-32767, 32767);
+		}
+		TArray<uint32> PackedRotations;
+		PackedRotations.Init(3u << 30 | 511u << 20 | 511u << 10 | 511u, NumBones);
+		Pose.SetNum(NumBones);
+		Pose.UnpackPacked(reinterpret_cast<const uint8*>(Steps.GetData()), PositionScale, reinterpret_cast<const uint8*>(PackedRotations.GetData()));
+		bool bPositionsMatch = true;
+		for (int32 Bone = 0; Bone < NumBones; Bone++)
+		{
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				bPositionsMatch &= IsBitIdentical(Pose.GetComponent(FRgbPoseBuffer::X + Axis)[Bone], Steps[Bone * 3 + Axis] * PositionScale);
+			}
+		}
+		TestTrue(FString::Printf(TEXT("%d packed positions dequantise"), NumBones), bPositionsMatch);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseBufferConvertTest, "RgbPoseLiveLink.PoseBuffer.ConvertAndNormalize",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseBufferConvertTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseBufferTests;
+
+	FRgbPoseSpaceConversion Swizzle;
+	Swizzle.AxisOrder[0] = 2;
+	Swizzle.AxisOrder[1] = 0;
+	Swizzle.AxisOrder[2] = 1;
+	Swizzle.PositionSigns[1] = -1.0f;
+	Swizzle.PositionScale = 2.5f;
+	Swizzle.RotationSigns[0] = -1.0f;
+	Swizzle.RotationSigns[3] = -1.0f;
+	const FRgbPoseSpaceConversion* Conversions[] = { &RgbPoseProtocol::GetBlenderSpaceConversion(), &Swizzle };
+
+	FRandomStream Random(20);
+	FRgbPoseBuffer Pose;
+	for (const FRgbPoseSpaceConversion* Conversion : Conversions)
+	{
+		for (int32 NumBones : BoneCounts)
+		{
+			TArray<float> Positions;
+			TArray<float> Rotations;
+			MakeInterleaved(Random, NumBones, Positions, Rotations);
+			// A degenerate rotation, normalising it gives the identity
+			Rotations[0] = Rotations[1] = Rotations[2] = Rotations[3] = 0.0f;
+			Pose.SetNum(NumBones);
+			Pose.UnpackFloats(reinterpret_cast<const uint8*>(Positions.GetData()), reinterpret_cast<const uint8*>(Rotations.GetData()));
+
+			///		SCALAR REFERENCE, ONE MULTIPLY BY THE SAME FACTOR PER COMPONENT, THEN A SCALAR NORMALISE
+			TArray<float> ExpectedPositions;
+			TArray<float> ExpectedRotations;
+			ExpectedPositions.SetNumUninitialized(NumBones * 3);
+			ExpectedRotations.SetNumUninitialized(NumBones * 4);
+			for (int32 Bone = 0; Bone < NumBones; Bone++)
+			{
+				for (int32 Axis = 0; Axis < 3; Axis++)
+				{
+					const int32 From = Conversion->AxisOrder[Axis];
+					ExpectedPositions[Bone * 3 + Axis] = Positions[Bone * 3 + From] * (Conversion->PositionSigns[Axis] * Conversion->PositionScale);
+					ExpectedRotations[Bone * 4 + Axis] = Rotations[Bone * 4 + From] * Conversion->RotationSigns[Axis];
+				}
+				ExpectedRotations[Bone * 4 + 3] = Rotations[Bone * 4 + 3] * Conversion->RotationSigns[3];
+			}
+
+			Pose.ConvertSpace(*Conversion);
+			TestTrue(FString::Printf(TEXT("%d bones convert"), NumBones), MatchesInterleaved(Pose, ExpectedPositions, ExpectedRotations));
+			TestTrue(FString::Printf(TEXT("%d converted bones keep their padding"), NumBones), IsPaddingIdentity(Pose));
+
+			Pose.NormalizeRotations();
+			for (int32 Bone = 0; Bone < NumBones; Bone++)
+			{
+				FQuat Expected(ExpectedRotations[Bone * 4], ExpectedRotations[Bone * 4 + 1], ExpectedRotations[Bone * 4 + 2], ExpectedRotations[Bone * 4 + 3]);
+				Expected = Expected.SizeSquared() > SMALL_NUMBER ? Expected.GetNormalized() : FQuat::Identity;
+				const FQuat Normalized(Pose.GetComponent(FRgbPoseBuffer::QX)[Bone], Pose.GetComponent(FRgbPoseBuffer::QY)[Bone], Pose.GetComponent(FRgbPoseBuffer::QZ)[Bone], Pose.GetComponent(FRgbPoseBuffer::QW)[Bone]);
+				TestTrue(FString::Printf(TEXT("Bone %d of %d normalises to %s"), Bone, NumBones, *Expected.ToString()), Normalized.Equals(Expected, 1e-6f));
+			}
+			TestTrue(FString::Printf(TEXT("%d normalised bones keep their padding"), NumBones), IsPaddingIdentity(Pose));
+
+			///		TRANSFORMS ARE BUILT FROM THE COMPONENTS AS THEY ARE
+			TArray<FTransform> Transforms;
+			Pose.ToTransforms(Transforms);
+			if (TestEqual(TEXT("Transforms"), Transforms.Num(), NumBones))
+			{
+				const int32 Last = NumBones - 1;
+				const FVector Translation = Transforms[Last].GetTranslation();
+				TestTrue(TEXT("Last transform"), IsBitIdentical(Translation.X, ExpectedPositions[Last * 3]) && IsBitIdentical(Translation.Y, ExpectedPositions[Last * 3 + 1])
+					&& IsBitIdentical(Translation.Z, ExpectedPositions[Last * 3 + 2]));
+			}
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,156 @@
+﻿#include "Async/Async.h"
+#include "Misc/AutomationTest.h"
+#include "RgbPoseDatagramRing.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RgbPoseDatagramRingTests
+{
+	static bool Write(FRgbPoseDatagramRing& Ring, uint64 Value)
+	{
+		uint8* Slot = Ring.BeginWrite();
+		if (Slot == nullptr)
+		{
+			return false;
+		}
+		// Twice, a torn read shows up as two different halves
+		FMemory::Memcpy(Slot, &Value, sizeof(uint64));
+		FMemory::Memcpy(Slot + sizeof(uint64), &Value, sizeof(uint64));
+		Ring.CommitWrite(2 * sizeof(uint64), (double)Value);
+		return true;
+	}
+
+	static bool Read(FRgbPoseDatagramRing& Ring, uint64& OutValue, bool& bOutTorn)
+	{
+		int32 Size = 0;
+		double ReceiveTime = 0.0;
+		const uint8* Datagram = Ring.BeginRead(Size, ReceiveTime);
+		if (Datagram == nullptr)
+		{
+			return false;
+		}
+		uint64 Second;
+		FMemory::Memcpy(&OutValue, Datagram, sizeof(uint64));
+		FMemory::Memcpy(&Second, Datagram + sizeof(uint64), sizeof(uint64));
+		bOutTorn = Size != 2 * sizeof(uint64) || Second != OutValue || ReceiveTime != (double)OutValue;
+		Ring.EndRead();
+		return true;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseDatagramRingEvictionTest, "RgbPoseLiveLink.DatagramRing.Eviction",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseDatagramRingEvictionTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseDatagramRingTests;
+
+	FRgbPoseDatagramRing Ring;
+	Ring.Initialize(3, 16);
+	uint64 Value = 0;
+	bool bTorn = false;
+	TestFalse(TEXT("An empty ring has nothing to read"), Read(Ring, Value, bTorn));
+
+	///		A FULL RING EVICTS ITS OLDEST DATAGRAMS, THE NEWEST ONES ARE READ IN ORDER
+	for (uint64 Index = 0; Index < 5; Index++)
+	{
+		TestTrue(TEXT("Writes into a ring nobody reads"), Write(Ring, Index));
+	}
+	TestEqual(TEXT("Overflows"), Ring.GetNumOverflows(), 2);
+	TestEqual(TEXT("Dropped"), Ring.GetNumDropped(), 2);
+	for (uint64 Expected = 2; Expected < 5; Expected++)
+	{
+		TestTrue(TEXT("Newest datagrams are kept"), Read(Ring, Value, bTorn) && Value == Expected && !bTorn);
+	}
+	TestFalse(TEXT("Every datagram was read"), Read(Ring, Value, bTorn));
+
+	///		THE SLOT THE CONSUMER HOLDS IS NEVER WRITTEN, THE PRODUCER IS TURNED AWAY UNTIL IT IS RELEASED
+	Ring.Initialize(3, 16);
+	Write(Ring, 0);
+	Write(Ring, 1);
+	Write(Ring, 2);
+	int32 Size = 0;
+	double ReceiveTime = 0.0;
+	const uint8* Held = Ring.BeginRead(Size, ReceiveTime);
+	TestNotNull(TEXT("Oldest datagram"), Held);
+	TestTrue(TEXT("The free slot is written"), Write(Ring, 3));
+	TestFalse(TEXT("The held slot is not written"), Write(Ring, 4));
+	FMemory::Memcpy(&Value, Held, sizeof(uint64));
+	TestTrue(TEXT("The held datagram is untouched"), Value == 0);
+	Ring.EndRead();
+	TestTrue(TEXT("The released slot is written"), Write(Ring, 4));
+	for (uint64 Expected = 2; Expected < 5; Expected++)
+	{
+		TestTrue(TEXT("Datagrams after the held one"), Read(Ring, Value, bTorn) && Value == Expected && !bTorn);
+	}
+
+	///		CANCELLED WRITES ARE NEVER READ, DROPPED ONES ARE COUNTED
+	Ring.Initialize(3, 16);
+	Ring.BeginWrite();
+	Ring.CancelWrite(true);
+	Ring.BeginWrite();
+	Ring.CancelWrite(false);
+	TestEqual(TEXT("Dropped"), Ring.GetNumDropped(), 1);
+	TestFalse(TEXT("Cancelled writes are not read"), Read(Ring, Value, bTorn));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseDatagramRingThreadsTest, "RgbPoseLiveLink.DatagramRing.Threads",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseDatagramRingThreadsTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseDatagramRingTests;
+
+	///		A PRODUCER FASTER THAN THE CONSUMER, EVERY DATAGRAM READ IS WHOLE AND NEWER THAN THE LAST ONE
+	static const uint64 NumDatagrams = 200000;
+	FRgbPoseDatagramRing Ring;
+	Ring.Initialize(8, 16);
+	std::atomic<bool> bProducerDone(false);
+	TFuture<void> Producer = Async(EAsyncExecution::Thread, [&Ring, &bProducerDone]()
+	{
+		for (uint64 Index = 1; Index <= NumDatagrams;)
+		{
+			if (Write(Ring, Index))
+			{
+				Index++;
+			}
+			else
+			{
+				FPlatformProcess::YieldThread();
+			}
+		}
+		bProducerDone.store(true);
+	});
+
+	uint64 Last = 0;
+	int64 NumRead = 0;
+	int64 NumTorn = 0;
+	int64 NumOutOfOrder = 0;
+	for (;;)
+	{
+		const bool bDone = bProducerDone.load();
+		uint64 Value = 0;
+		bool bTorn = false;
+		if (Read(Ring, Value, bTorn))
+		{
+			NumRead++;
+			NumTorn += bTorn ? 1 : 0;
+			NumOutOfOrder += Value <= Last ? 1 : 0;
+			Last = Value;
+		}
+		else if (bDone)
+		{
+			break;
+		}
+	}
+	Producer.Wait();
+
+	TestEqual(TEXT("Torn datagrams"), NumTorn, (int64)0);
+	TestEqual(TEXT("Datagrams out of order"), NumOutOfOrder, (int64)0);
+	TestTrue(TEXT("The last datagram is read"), Last == NumDatagrams);
+	TestEqual(TEXT("Every datagram is read or counted dropped"), NumRead + Ring.GetNumDropped(), (int64)NumDatagrams);
+	return true;
+}
+
+#endif
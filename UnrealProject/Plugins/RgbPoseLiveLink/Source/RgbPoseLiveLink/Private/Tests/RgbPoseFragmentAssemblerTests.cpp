@@ -0,0 +1,163 @@
+﻿#include "Misc/AutomationTest.h"
+#include "RgbPoseFragmentAssembler.h"
+#include "RgbPoseProtocol.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RgbPoseFragmentAssemblerTests
+{
+	struct FChunk
+	{
+		FRgbPoseFragmentHeader Header;
+		TArray<uint8> Bytes;
+	};
+
+	/** Splits the message the way send_datagram in BlenderPy.py does */
+	static TArray<FChunk> Split(const TArray<uint8>& Message, uint32 MessageId, int32 ChunkSize)
+	{
+		TArray<FChunk> Chunks;
+		const int32 ChunkCount = (Message.Num() + ChunkSize - 1) / ChunkSize;
+		for (int32 Index = 0; Index < ChunkCount; Index++)
+		{
+			FChunk& Chunk = Chunks.AddDefaulted_GetRef();
+			Chunk.Header.MessageId = MessageId;
+			Chunk.Header.MessageSize = Message.Num();
+			Chunk.Header.ChunkOffset = Index * ChunkSize;
+			Chunk.Header.ChunkIndex = Index;
+			Chunk.Header.ChunkCount = ChunkCount;
+			Chunk.Bytes.Append(Message.GetData() + Index * ChunkSize, FMath::Min(ChunkSize, Message.Num() - Index * ChunkSize));
+		}
+		return Chunks;
+	}
+
+	static TArray<uint8> MakeMessage(int32 Size, uint8 Seed)
+	{
+		TArray<uint8> Message;
+		Message.SetNumUninitialized(Size);
+		for (int32 Index = 0; Index < Size; Index++)
+		{
+			Message[Index] = (uint8)(Index * 31 + Seed);
+		}
+		return Message;
+	}
+
+	static bool Add(FRgbPoseFragmentAssembler& Assembler, const FChunk& Chunk, double ReceiveTime, TArray<uint8>& OutMessage)
+	{
+		return Assembler.Add(Chunk.Header, Chunk.Bytes.GetData(), Chunk.Bytes.Num(), ReceiveTime, OutMessage);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseFragmentAssemblerTest, "RgbPoseLiveLink.FragmentAssembler",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseFragmentAssemblerTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseFragmentAssemblerTests;
+
+	///		CHUNKS IN ANY ORDER, REPEATED ONES IGNORED, GIVE BACK THE MESSAGE ONCE THE LAST ONE IS IN
+	{
+		FRgbPoseFragmentAssembler Assembler;
+		const TArray<uint8> Message = MakeMessage(10000, 1);
+		const TArray<FChunk> Chunks = Split(Message, 7, 1300);
+		TArray<uint8> Assembled;
+		bool bCompleted = false;
+		for (int32 Index = Chunks.Num() - 1; Index >= 0; Index--)
+		{
+			TestFalse(TEXT("Not complete before the last chunk"), bCompleted);
+			bCompleted = Add(Assembler, Chunks[Index], 0.0, Assembled);
+			if (Index == Chunks.Num() - 2)
+			{
+				TestFalse(TEXT("A repeated chunk"), Add(Assembler, Chunks[Index], 0.0, Assembled));
+			}
+		}
+		TestTrue(TEXT("Complete"), bCompleted);
+		TestTrue(TEXT("Same bytes as sent"), Assembled == Message);
+		TestEqual(TEXT("Reassembled"), Assembler.GetNumReassembled(), 1);
+		TestEqual(TEXT("Evicted"), Assembler.GetNumEvicted(), 0);
+	}
+
+	///		A MESSAGE STILL INCOMPLETE AFTER THE TIMEOUT IS THROWN AWAY, ITS LATE CHUNKS START OVER
+	{
+		FRgbPoseFragmentAssembler Assembler;
+		Assembler.SetTimeout(0.25);
+		const TArray<FChunk> Chunks = Split(MakeMessage(3000, 2), 1, 1000);
+		TArray<uint8> Assembled;
+		Add(Assembler, Chunks[0], 0.0, Assembled);
+		Add(Assembler, Chunks[1], 0.1, Assembled);
+		TestFalse(TEXT("The last chunk arrives too late"), Add(Assembler, Chunks[2], 0.5, Assembled));
+		TestEqual(TEXT("Evicted"), Assembler.GetNumEvicted(), 1);
+	}
+
+	///		A REUSED MESSAGE ID WITH ANOTHER LAYOUT IS A RESTARTED SENDER, ITS NEW MESSAGE STILL COMES THROUGH
+	{
+		FRgbPoseFragmentAssembler Assembler;
+		const TArray<FChunk> Old = Split(MakeMessage(3000, 3), 0, 1000);
+		const TArray<uint8> Message = MakeMessage(1500, 4);
+		const TArray<FChunk> New = Split(Message, 0, 1000);
+		TArray<uint8> Assembled;
+		Add(Assembler, Old[0], 0.0, Assembled);
+		Add(Assembler, New[0], 0.0, Assembled);
+		TestTrue(TEXT("New message"), Add(Assembler, New[1], 0.0, Assembled) && Assembled == Message);
+		TestEqual(TEXT("Evicted"), Assembler.GetNumEvicted(), 1);
+	}
+
+	///		TOO MANY MESSAGES AT ONCE EVICT THE OLDEST
+	{
+		FRgbPoseFragmentAssembler Assembler;
+		TArray<TArray<FChunk>> Messages;
+		TArray<uint8> Assembled;
+		for (uint32 MessageId = 0; MessageId < 17; MessageId++)
+		{
+			Messages.Add(Split(MakeMessage(2000, (uint8)MessageId), MessageId, 1000));
+			Add(Assembler, Messages.Last()[0], MessageId * 0.001, Assembled);
+		}
+		TestEqual(TEXT("Evicted"), Assembler.GetNumEvicted(), 1);
+		TestFalse(TEXT("The oldest message was dropped"), Add(Assembler, Messages[0][1], 0.02, Assembled));
+		TestTrue(TEXT("A newer message completes"), Add(Assembler, Messages[16][1], 0.02, Assembled));
+	}
+
+	///		SIZES A SENDER COULD NOT HAVE SENT ARE REFUSED
+	{
+		FRgbPoseFragmentAssembler Assembler;
+		TArray<uint8> Assembled;
+		FChunk Huge = Split(MakeMessage(100, 5), 9, 100)[0];
+		Huge.Header.MessageSize = 16 * 1024 * 1024 + 1;
+		TestFalse(TEXT("Message over the size limit"), Add(Assembler, Huge, 0.0, Assembled));
+
+		// Every chunk arrived but they do not cover the message
+		TArray<FChunk> Short = Split(MakeMessage(2000, 6), 10, 1000);
+		Short[1].Bytes.SetNum(500);
+		Add(Assembler, Short[0], 0.0, Assembled);
+		TestFalse(TEXT("Chunks short of the message size"), Add(Assembler, Short[1], 0.0, Assembled));
+		TestEqual(TEXT("Evicted"), Assembler.GetNumEvicted(), 1);
+	}
+
+	///		FRAGMENT HEADERS POINTING OUTSIDE THE MESSAGE NEVER REACH THE ASSEMBLER
+	{
+		TArray<uint8> Payload;
+		Payload.SetNumZeroed(sizeof(FRgbPoseFragmentHeader) + 100);
+		FRgbPosePacketHeader Header;
+		FMemory::Memzero(Header);
+		Header.PacketType = (uint8)ERgbPosePacketType::Fragment;
+		Header.PayloadSize = Payload.Num();
+		FRgbPoseFragmentHeader Fragment;
+		const uint8* Chunk = nullptr;
+		int32 ChunkSize = 0;
+
+		FRgbPoseFragmentHeader Written = { 1, 200, 100, 1, 2 };
+		FMemory::Memcpy(Payload.GetData(), &Written, sizeof(Written));
+		TestTrue(TEXT("Chunk at the end of the message"), RgbPoseProtocol::ReadFragment(Header, Payload.GetData(), Fragment, Chunk, ChunkSize) && ChunkSize == 100);
+
+		Written.ChunkOffset = 101;
+		FMemory::Memcpy(Payload.GetData(), &Written, sizeof(Written));
+		TestFalse(TEXT("Chunk past the end of the message"), RgbPoseProtocol::ReadFragment(Header, Payload.GetData(), Fragment, Chunk, ChunkSize));
+
+		Written.ChunkOffset = 0;
+		Written.ChunkIndex = 2;
+		FMemory::Memcpy(Payload.GetData(), &Written, sizeof(Written));
+		TestFalse(TEXT("Chunk index past the chunk count"), RgbPoseProtocol::ReadFragment(Header, Payload.GetData(), Fragment, Chunk, ChunkSize));
+	}
+	return true;
+}
+
+#endif
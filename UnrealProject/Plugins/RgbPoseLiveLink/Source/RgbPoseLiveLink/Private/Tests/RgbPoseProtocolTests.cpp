@@ -0,0 +1,127 @@
+﻿#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+#include "RgbPoseBuffer.h"
+#include "RgbPoseProtocol.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RgbPoseProtocolTests
+{
+	static const double SmallestThreeRange = 0.70710678118654752;
+
+	/** Same packing as pack_smallest_three in BlenderPy.py */
+	static uint32 PackSmallestThree(FQuat Rotation)
+	{
+		double Components[4] = { Rotation.X, Rotation.Y, Rotation.Z, Rotation.W };
+		int32 Largest = 0;
+		for (int32 Component = 1; Component < 4; Component++)
+		{
+			Largest = FMath::Abs(Components[Component]) > FMath::Abs(Components[Largest]) ? Component : Largest;
+		}
+		const double Sign = Components[Largest] < 0.0 ? -1.0 : 1.0;
+		uint32 Word = (uint32)Largest << 30;
+		int32 Shift = 20;
+		for (int32 Component = 0; Component < 4; Component++)
+		{
+			if (Component != Largest)
+			{
+				const double Step = FMath::RoundToDouble((Components[Component] * Sign + SmallestThreeRange) / (2.0 * SmallestThreeRange) * 1023.0);
+				Word |= (uint32)FMath::Clamp(Step, 0.0, 1023.0) << Shift;
+				Shift -= 10;
+			}
+		}
+		return Word;
+	}
+
+	/** A packed pose packet of the rotations, with each position bone index times the scale */
+	static void MakePackedPose(const TArray<FQuat>& Rotations, float PositionScale, FRgbPosePacketHeader& OutHeader, TArray<uint8>& OutPayload)
+	{
+		OutPayload.Reset();
+		OutPayload.Append(reinterpret_cast<const uint8*>(&PositionScale), sizeof(float));
+		for (int32 Bone = 0; Bone < Rotations.Num(); Bone++)
+		{
+			const int16 Position[3] = { (int16)Bone, (int16)-Bone, (int16)(Bone * 100) };
+			OutPayload.Append(reinterpret_cast<const uint8*>(Position), sizeof(Position));
+		}
+		for (const FQuat& Rotation : Rotations)
+		{
+			const uint32 Word = PackSmallestThree(Rotation);
+			OutPayload.Append(reinterpret_cast<const uint8*>(&Word), sizeof(uint32));
+		}
+
+		FMemory::Memzero(OutHeader);
+		OutHeader.Magic = RgbPoseProtocol::PacketMagic;
+		OutHeader.Version = RgbPoseProtocol::ProtocolVersion;
+		OutHeader.HeaderSize = sizeof(FRgbPosePacketHeader);
+		OutHeader.PacketType = (uint8)ERgbPosePacketType::Pose;
+		OutHeader.Flags = ERgbPosePacketFlags::Packed;
+		OutHeader.BoneCount = Rotations.Num();
+		OutHeader.PayloadSize = OutPayload.Num();
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseProtocolPackedPoseTest, "RgbPoseLiveLink.Protocol.PackedPose",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseProtocolPackedPoseTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseProtocolTests;
+
+	///		THE LARGEST COMPONENT IN EVERY PLACE, NEGATIVE ONES, TIES, THEN RANDOM ROTATIONS
+	TArray<FQuat> Rotations =
+	{
+		FQuat::Identity, FQuat(1.0f, 0.0f, 0.0f, 0.0f), FQuat(0.0f, -1.0f, 0.0f, 0.0f), FQuat(0.0f, 0.0f, 1.0f, 0.0f),
+		FQuat(0.0f, 0.0f, 0.0f, -1.0f), FQuat(0.5f, 0.5f, 0.5f, 0.5f), FQuat(-0.5f, 0.5f, -0.5f, 0.5f),
+		FQuat(0.70710678f, 0.0f, 0.0f, 0.70710678f),
+	};
+	FRandomStream Random(19);
+	while (Rotations.Num() < 64)
+	{
+		FQuat Rotation(Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f));
+		if (Rotation.SizeSquared() > KINDA_SMALL_NUMBER)
+		{
+			Rotation.Normalize();
+			Rotations.Add(Rotation);
+		}
+	}
+
+	///		EVERY COUNT UP TO THREE BLOCKS OF FOUR, SO BOTH THE VECTOR LOOP AND THE SCALAR TAIL DECODE
+	static const float PositionScale = 0.01f;
+	for (int32 NumBones = 1; NumBones <= 13; NumBones++)
+	{
+		for (int32 First = 0; First + NumBones <= Rotations.Num(); First += NumBones)
+		{
+			const TArray<FQuat> Sent(Rotations.GetData() + First, NumBones);
+			FRgbPosePacketHeader Header;
+			TArray<uint8> Payload;
+			MakePackedPose(Sent, PositionScale, Header, Payload);
+
+			FRgbPoseBuffer Pose;
+			if (!TestTrue(TEXT("Packed pose is read"), RgbPoseProtocol::ReadPose(Header, Payload.GetData(), Pose)) || !TestEqual(TEXT("Bones"), Pose.Num(), NumBones))
+			{
+				return false;
+			}
+			for (int32 Bone = 0; Bone < NumBones; Bone++)
+			{
+				const FVector Position(Pose.GetComponent(FRgbPoseBuffer::X)[Bone], Pose.GetComponent(FRgbPoseBuffer::Y)[Bone], Pose.GetComponent(FRgbPoseBuffer::Z)[Bone]);
+				TestTrue(TEXT("Position is steps times the scale"), Position.Equals(FVector((float)Bone, (float)-Bone, (float)(Bone * 100)) * PositionScale, 1e-4f));
+
+				///		THE SAME ROTATION UP TO SIGN, WITHIN HALF A STEP PER COMPONENT
+				const FQuat Decoded(Pose.GetComponent(FRgbPoseBuffer::QX)[Bone], Pose.GetComponent(FRgbPoseBuffer::QY)[Bone], Pose.GetComponent(FRgbPoseBuffer::QZ)[Bone], Pose.GetComponent(FRgbPoseBuffer::QW)[Bone]);
+				TestTrue(FString::Printf(TEXT("%s decodes to %s"), *Sent[Bone].ToString(), *Decoded.ToString()), FMath::Abs(Decoded | Sent[Bone]) > 0.9999f);
+				TestTrue(TEXT("Decoded rotation is unit length"), FMath::IsNearlyEqual(Decoded.SizeSquared(), 1.0f, 4e-3f));
+			}
+		}
+	}
+
+	///		SIZES THAT DO NOT FIT THE PAYLOAD ARE REFUSED
+	FRgbPosePacketHeader Header;
+	TArray<uint8> Payload;
+	MakePackedPose(Rotations, PositionScale, Header, Payload);
+	Header.PayloadSize--;
+	FRgbPoseBuffer Pose;
+	TestFalse(TEXT("Truncated packed pose"), RgbPoseProtocol::ReadPose(Header, Payload.GetData(), Pose));
+	return true;
+}
+
+#endif
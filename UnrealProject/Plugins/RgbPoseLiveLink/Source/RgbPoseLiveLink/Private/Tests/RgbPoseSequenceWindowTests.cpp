@@ -0,0 +1,78 @@
+﻿#include "Misc/AutomationTest.h"
+#include "RgbPoseSequenceWindow.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RgbPoseSequenceWindowTests
+{
+	static bool IsResult(FRgbPoseSequenceWindow& Window, uint32 Sequence, ERgbPoseSequenceResult Expected, int32 ExpectedLostChange)
+	{
+		int32 LostChange = 0;
+		const ERgbPoseSequenceResult Result = Window.Add(Sequence, LostChange);
+		return Result == Expected && LostChange == ExpectedLostChange;
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRgbPoseSequenceWindowTest, "RgbPoseLiveLink.SequenceWindow",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FRgbPoseSequenceWindowTest::RunTest(const FString& Parameters)
+{
+	using namespace RgbPoseSequenceWindowTests;
+
+	///		GAPS ARE COUNTED LOST, AND GIVEN BACK WHEN THE MISSING FRAME TURNS UP LATE
+	{
+		FRgbPoseSequenceWindow Window;
+		TestTrue(TEXT("The first frame starts the window"), IsResult(Window, 100, ERgbPoseSequenceResult::Newer, 0));
+		TestTrue(TEXT("Next frame"), IsResult(Window, 101, ERgbPoseSequenceResult::Newer, 0));
+		TestTrue(TEXT("Two frames skipped"), IsResult(Window, 104, ERgbPoseSequenceResult::Newer, 2));
+		TestTrue(TEXT("A skipped frame arrives late"), IsResult(Window, 102, ERgbPoseSequenceResult::Late, -1));
+		TestTrue(TEXT("The late frame again"), IsResult(Window, 102, ERgbPoseSequenceResult::Duplicate, 0));
+		TestTrue(TEXT("The newest frame again"), IsResult(Window, 104, ERgbPoseSequenceResult::Duplicate, 0));
+		TestTrue(TEXT("A frame from before the window started"), IsResult(Window, 99, ERgbPoseSequenceResult::Late, 0));
+	}
+
+	///		THE COUNT ROLLS OVER
+	{
+		FRgbPoseSequenceWindow Window;
+		int32 LostChange = 0;
+		Window.Add(0xFFFFFFFEu, LostChange);
+		TestTrue(TEXT("Last sequence number"), IsResult(Window, 0xFFFFFFFFu, ERgbPoseSequenceResult::Newer, 0));
+		TestTrue(TEXT("Wrapped to zero"), IsResult(Window, 0, ERgbPoseSequenceResult::Newer, 0));
+		TestTrue(TEXT("Late across the wrap"), IsResult(Window, 0xFFFFFFFFu, ERgbPoseSequenceResult::Duplicate, 0));
+	}
+
+	///		A RESTARTED SENDER COUNTS FROM ZERO AGAIN, ITS FIRST FRAME IS ALREADY KEPT
+	{
+		FRgbPoseSequenceWindow Window;
+		int32 LostChange = 0;
+		for (uint32 Sequence = 0; Sequence < 1000; Sequence++)
+		{
+			Window.Add(Sequence, LostChange);
+		}
+		TestTrue(TEXT("Far older than the window"), IsResult(Window, 0, ERgbPoseSequenceResult::Newer, 0));
+		TestTrue(TEXT("Counting on from the restart"), IsResult(Window, 1, ERgbPoseSequenceResult::Newer, 0));
+	}
+
+	///		A SENDER RESTARTED JUST AFTER ITS LAST START IS ONLY TRUSTED AFTER A RUN OF STALE FRAMES
+	{
+		FRgbPoseSequenceWindow Window;
+		int32 LostChange = 0;
+		for (uint32 Sequence = 0; Sequence < 40; Sequence++)
+		{
+			Window.Add(Sequence, LostChange);
+		}
+		int32 NumRejected = 0;
+		ERgbPoseSequenceResult Result = ERgbPoseSequenceResult::Late;
+		for (uint32 Sequence = 0; Sequence < 40 && Result != ERgbPoseSequenceResult::Newer; Sequence++)
+		{
+			Result = Window.Add(Sequence, LostChange);
+			NumRejected += Result != ERgbPoseSequenceResult::Newer ? 1 : 0;
+		}
+		TestEqual(TEXT("Stale frames rejected before the restart"), NumRejected, 15);
+		TestTrue(TEXT("The window restarted"), Result == ERgbPoseSequenceResult::Newer);
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Templates/UniquePtr.h"
+
+/** Point of the receiving pipeline a frame's latency is measured at, counted from the sender's timestamp */
+enum class ERgbPoseLatencyStage : uint8
+{
+	// Datagram read off the socket
+	Receive,
+	// Frame decoded
+	Parse,
+	// Frame handed to LiveLink
+	Push,
+	// Frame first read by an animation node, counted from its arrival for senders that do not stamp frames
+	Evaluate,
+	Num,
+};
+
+/** Percentiles of one histogram, in milliseconds */
+struct RGBPOSELIVELINK_API FRgbPoseLatencySummary
+{
+	int64 NumSamples = 0;
+	double P50 = 0.0;
+	double P95 = 0.0;
+	double P99 = 0.0;
+};
+
+/**
+ * Latency histogram with fixed 0.1 ms buckets, anything slower than the last bucket is counted in it
+ */
+class RGBPOSELIVELINK_API FRgbPoseLatencyHistogram
+{
+public:
+	FRgbPoseLatencyHistogram();
+
+	void Add(double Milliseconds);
+
+	/** Upper edge of the bucket holding the given fraction of the samples */
+	double GetPercentile(double Fraction) const;
+
+	FRgbPoseLatencySummary GetSummary() const;
+
+private:
+	TArray<uint32> Buckets;
+	int64 NumSamples;
+};
+
+/**
+ * Per subject histograms of the time from the sender's timestamp to each stage of the pipeline, and of the jitter between
+ * the receive latencies of consecutive frames. Samples come from the socket thread, the game thread and animation workers.
+ * The sender's timestamps are mapped with the smallest offset seen, so latencies are relative to the fastest frame.
+ *
+ * "RgbPose.LatencyReport" logs every subject's percentiles, "RgbPose.LatencyReset" starts over.
+ */
+class RGBPOSELIVELINK_API FRgbPoseLatencyTracker
+{
+public:
+	static FRgbPoseLatencyTracker& Get();
+
+	/** Records how long after it was sent a frame of the subject reached Stage */
+	void AddSample(FName SubjectName, ERgbPoseLatencyStage Stage, double LatencySeconds);
+
+	FRgbPoseLatencySummary GetSummary(FName SubjectName, ERgbPoseLatencyStage Stage) const;
+
+	/** Difference between the receive latencies of consecutive frames of the subject */
+	FRgbPoseLatencySummary GetJitterSummary(FName SubjectName) const;
+
+	TArray<FName> GetSubjectNames() const;
+
+	void Reset();
+
+private:
+	struct FSubjectLatency
+	{
+		FRgbPoseLatencyHistogram Stages[(int32)ERgbPoseLatencyStage::Num];
+		FRgbPoseLatencyHistogram Jitter;
+		double LastReceiveLatency = -1.0;
+	};
+
+	mutable FCriticalSection Lock;
+	// Histograms are large, they stay in place while the map grows
+	TMap<FName, TUniquePtr<FSubjectLatency>> Subjects;
+};
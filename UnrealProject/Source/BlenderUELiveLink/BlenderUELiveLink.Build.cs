@@ -10,7 +10,7 @@ public class BlenderUELiveLink : ModuleRules
 	
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "LiveLink" , "AnimGraphRuntime",
 			"AnimGraph",
-			"BlueprintGraph","LiveLinkInterface"});
+			"BlueprintGraph","LiveLinkInterface", "RgbPoseLiveLink"});
 
 		PrivateDependencyModuleNames.AddRange(new string[] {  });
 
@@ -0,0 +1,65 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RGBLiveLinkSnapshotCache.h"
+#include "ILiveLinkClient.h"
+#include "RgbPoseLatencyTracker.h"
+#include "Roles/LiveLinkAnimationRole.h"
+#include "Roles/LiveLinkAnimationTypes.h"
+
+FRGBLiveLinkSnapshotCache& FRGBLiveLinkSnapshotCache::Get()
+{
+	static FRGBLiveLinkSnapshotCache Instance;
+	return Instance;
+}
+
+TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe> FRGBLiveLinkSnapshotCache::GetSnapshot(ILiveLinkClient& Client, FName SubjectName)
+{
+	const uint64 FrameCounter = GFrameCounter;
+	{
+		FReadScopeLock ReadLock(Lock);
+		const TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe>* Found = Snapshots.Find(SubjectName);
+		if (Found != nullptr && (*Found)->FrameCounter == FrameCounter)
+		{
+			return *Found;
+		}
+	}
+
+	///		EVALUATING OUTSIDE THE LOCK, NODES RACING ON THE SAME SUBJECT AT WORST EVALUATE IT TWICE AND THE FIRST ONE IS KEPT
+	TSharedRef<FRGBLiveLinkSnapshot, ESPMode::ThreadSafe> Snapshot = MakeShared<FRGBLiveLinkSnapshot, ESPMode::ThreadSafe>();
+	Snapshot->FrameCounter = FrameCounter;
+
+	FLiveLinkSubjectFrameData SubjectFrameData;
+	TSubclassOf<ULiveLinkRole> SubjectRole = Client.GetSubjectRole(SubjectName);
+	if (SubjectRole && SubjectRole->IsChildOf(ULiveLinkAnimationRole::StaticClass())
+		&& Client.EvaluateFrame_AnyThread(SubjectName, ULiveLinkAnimationRole::StaticClass(), SubjectFrameData))
+	{
+		const FLiveLinkSkeletonStaticData* SkeletonData = SubjectFrameData.StaticData.Cast<FLiveLinkSkeletonStaticData>();
+		FLiveLinkAnimationFrameData* FrameData = SubjectFrameData.FrameData.Cast<FLiveLinkAnimationFrameData>();
+		if (SkeletonData != nullptr && FrameData != nullptr)
+		{
+			Snapshot->BoneNames = SkeletonData->BoneNames;
+			Snapshot->Transforms = MoveTemp(FrameData->Transforms);
+			Snapshot->SourceTime = FrameData->WorldTime.GetSourceTime();
+		}
+	}
+
+	FWriteScopeLock WriteLock(Lock);
+	TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe>* Found = Snapshots.Find(SubjectName);
+	if (Found != nullptr && (*Found)->FrameCounter == FrameCounter)
+	{
+		return *Found;
+	}
+
+	///		A FRAME IS TIMED THE FIRST TICK IT IS APPLIED, NOT AGAIN ON EVERY TICK IT IS HELD FOR
+	if (Snapshot->SourceTime > 0.0 && (Found == nullptr || (*Found)->SourceTime != Snapshot->SourceTime))
+	{
+		FRgbPoseLatencyTracker::Get().AddSample(SubjectName, ERgbPoseLatencyStage::Evaluate, FPlatformTime::Seconds() - Snapshot->SourceTime);
+	}
+	if (Found == nullptr)
+	{
+		return Snapshots.Add(SubjectName, Snapshot);
+	}
+	*Found = Snapshot;
+	return *Found;
+}
@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeRWLock.h"
+
+class ILiveLinkClient;
+
+/**
+ * Animation frame of one LiveLink subject, evaluated once per engine tick and shared read-only by every node driven by it
+ */
+struct BLENDERUELIVELINK_API FRGBLiveLinkSnapshot
+{
+	// GFrameCounter of the tick the snapshot was evaluated on
+	uint64 FrameCounter = 0;
+
+	// Empty when the subject does not exist or is not an animation subject
+	TArray<FName> BoneNames;
+	TArray<FTransform> Transforms;
+
+	// Time the frame was sent, on the local clock, 0 when there is no frame
+	double SourceTime = 0.0;
+};
+
+/**
+ * Per tick cache of LiveLink subject frames, safe to use from parallel animation evaluation
+ */
+class BLENDERUELIVELINK_API FRGBLiveLinkSnapshotCache
+{
+public:
+	static FRGBLiveLinkSnapshotCache& Get();
+
+	/** Returns this tick's snapshot of the subject, evaluating it if this is the first node asking for it */
+	TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe> GetSnapshot(ILiveLinkClient& Client, FName SubjectName);
+
+private:
+	FRWLock Lock;
+	TMap<FName, TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe>> Snapshots;
+};
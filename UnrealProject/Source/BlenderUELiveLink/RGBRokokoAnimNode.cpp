@@ -2,75 +2,101 @@
 
 
 #include "RGBRokokoAnimNode.h"
+#include "RGBLiveLinkSnapshotCache.h"
 #include "Animation/AnimInstanceProxy.h"
 #include "Roles/LiveLinkAnimationRole.h"
 #include "Roles/LiveLinkAnimationTypes.h"
 #include "ILiveLinkClient.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Stats/Stats.h"
+
+// Per bone logging is VeryVerbose, compiled out unless the compile time verbosity here is raised
+DEFINE_LOG_CATEGORY_STATIC(LogRGBRokokoAnimNode, Log, Log);
+
+DECLARE_STATS_GROUP(TEXT("RGB Rokoko Anim Node"), STATGROUP_RGBRokokoAnimNode, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Evaluate"), STAT_RGBRokokoEvaluate, STATGROUP_RGBRokokoAnimNode);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bones Applied"), STAT_RGBRokokoBonesApplied, STATGROUP_RGBRokokoAnimNode);
 
 FRGBRokokoAnimNode::FRGBRokokoAnimNode()
 {
 	firstTime = true;
+	bLocalSpaceFastPath = false;
 }
 
 ///		INITIALIZES THE BONE REFERENCES FOR THE SKELETON (BONE REFERENCES ARE THEN USED TO ACCESS THE BONES AND APPLY TRANSFORMS TO THEM IN RUNTIME)
 void FRGBRokokoAnimNode::InitializeBoneReferences(const FBoneContainer& RequiredBones)
 {
-	for (size_t i = 0; i < RequiredBones.GetReferenceSkeleton().GetNum(); i++)
+	///		CALLED AGAIN ON LOD AND MESH CHANGES, SO THE REFERENCES ARE REBUILT RATHER THAN APPENDED AND THE REMAP IS INVALIDATED
+	BoneReferencesArray.Reset(RequiredBones.GetReferenceSkeleton().GetNum());
+	for (int32 i = 0; i < RequiredBones.GetReferenceSkeleton().GetNum(); i++)
 	{
 		BoneReferencesArray.Add(FBoneReference(RequiredBones.GetReferenceSkeleton().GetBoneName(i)));
 		BoneReferencesArray[i].Initialize(RequiredBones);
 	}
+	LiveLinkToCompactPose.Reset();
+	RemapBoneNames.Reset();
+}
+
+///		MAPS EVERY LIVE LINK BONE TO ITS COMPACT POSE INDEX ONCE, SO EVALUATION IS A STRAIGHT INDEXED LOOP
+void FRGBRokokoAnimNode::BuildBoneRemap(const TArray<FName>& LiveLinkBoneNames, const FBoneContainer& BoneContainer)
+{
+	const FReferenceSkeleton& RefSkeleton = BoneContainer.GetReferenceSkeleton();
+	LiveLinkToCompactPose.Reset(LiveLinkBoneNames.Num());
+	for (const FName& BoneName : LiveLinkBoneNames)
+	{
+		const int32 RefBoneIndex = RefSkeleton.FindBoneIndex(BoneName);
+		LiveLinkToCompactPose.Add(BoneReferencesArray.IsValidIndex(RefBoneIndex) ? BoneReferencesArray[RefBoneIndex].GetCompactPoseIndex(BoneContainer) : FCompactPoseBoneIndex(INDEX_NONE));
+	}
+	RemapBoneNames = LiveLinkBoneNames;
 }
 
 ///		FETCHES THE FRAME DATA FROM THE LIVE LINK CLIENT GIVEN THE SUBJECT NAME, AND APPLIES THEM TO APPROPRIATE BONES USING BONE REFERENCES 
 void FRGBRokokoAnimNode::EvaluateSkeletalControl_AnyThread(FComponentSpacePoseContext& Output, TArray<FBoneTransform>& OutBoneTransforms)
 {
-	///		GETTING THE SUBJECT FRAME DATA FROM LIVE LINK SUBJECT NAME PROVIDED IN BLUEPRINT
-	FLiveLinkSubjectName LiveLinkSubjectName = GetLiveLinkSubjectName();
-	TSubclassOf<ULiveLinkRole> SubjectRole = LiveLinkClient_AnyThread->GetSubjectRole(LiveLinkSubjectName);
-	FLiveLinkSubjectFrameData SubjectFrameData;
-	if (SubjectRole) {
-		if (SubjectRole->IsChildOf(ULiveLinkAnimationRole::StaticClass())) {
-			//Process animation data if the subject is from that type
-			if (LiveLinkClient_AnyThread->EvaluateFrame_AnyThread(LiveLinkSubjectName, ULiveLinkAnimationRole::StaticClass(), SubjectFrameData)) {}
-			else {
-				return;
-			}
-		}
-		else {
-			return;
-		}
-	}
-	else
+	TRACE_CPUPROFILER_EVENT_SCOPE(FRGBRokokoAnimNode::EvaluateSkeletalControl_AnyThread);
+	SCOPE_CYCLE_COUNTER(STAT_RGBRokokoEvaluate);
+
+	if (LiveLinkClient_AnyThread == nullptr)
+	{
 		return;
+	}
 
-	///		GETTING THE SKELETON DATA (STRUCTURE) AND FRAME DATA (BONE ROTATIONS AND TRANSLATIONS) FROM THE LIVE LINK SUBJECT FRAME
-	FLiveLinkSkeletonStaticData* SkeletonData = SubjectFrameData.StaticData.Cast<FLiveLinkSkeletonStaticData>();
-	FLiveLinkAnimationFrameData* FrameData = SubjectFrameData.FrameData.Cast<FLiveLinkAnimationFrameData>();
+	///		GETTING THE SUBJECT FRAME FROM THE SHARED CACHE, EVALUATED ONCE PER TICK NO MATTER HOW MANY NODES ARE DRIVEN BY IT
+	TSharedRef<const FRGBLiveLinkSnapshot, ESPMode::ThreadSafe> Snapshot = FRGBLiveLinkSnapshotCache::Get().GetSnapshot(*LiveLinkClient_AnyThread, RGBMocapActorName);
+	const TArray<FName>& BoneNames = Snapshot->BoneNames;
+	const TArray<FTransform>& Transforms = Snapshot->Transforms;
+
+	const FBoneContainer& BoneContainer = Output.Pose.GetPose().GetBoneContainer();
+	if (RemapBoneNames != BoneNames)
+	{
+		BuildBoneRemap(BoneNames, BoneContainer);
+	}
 
-	const TArray<FName>& SourceBoneNames = SkeletonData->PropertyNames;
-	for (size_t i = 0; i < SkeletonData->BoneNames.Num(); i++)
+	const int32 NumBones = FMath::Min(LiveLinkToCompactPose.Num(), Transforms.Num());
+	if (bLocalSpaceFastPath)
 	{
+		EvaluateLocalSpace(Output, Transforms, NumBones);
+		return;
+	}
 
-		int boneReferenceIndex = -1;
-		FBoneReference boneReference;
-		boneReference.BoneName = SkeletonData->BoneNames[i];
-		if (BoneReferencesArray.Find(boneReference, boneReferenceIndex)) {
-			UE_LOG(LogTemp, Warning, TEXT("Inside the source Location is %s %f %f %f Rotation is : x =  %f y =  %f z = %f w = %f"), *SkeletonData->BoneNames[i].ToString(), FrameData->Transforms[i].GetLocation().X, FrameData->Transforms[i].GetLocation().Y, FrameData->Transforms[i].GetLocation().Z
-				, FrameData->Transforms[i].GetRotation().X, FrameData->Transforms[i].GetRotation().Y, FrameData->Transforms[i].GetRotation().Z, FrameData->Transforms[i].GetRotation().W);
+	OutBoneTransforms.Reserve(NumBones);
+	for (int32 i = 0; i < NumBones; i++)
+	{
+		const FCompactPoseBoneIndex CompactPoseBoneToModify = LiveLinkToCompactPose[i];
+		if (CompactPoseBoneToModify.IsValid()) {
+			UE_LOG(LogRGBRokokoAnimNode, VeryVerbose, TEXT("Inside the source Location is %s %f %f %f Rotation is : x =  %f y =  %f z = %f w = %f"), *BoneNames[i].ToString(), Transforms[i].GetLocation().X, Transforms[i].GetLocation().Y, Transforms[i].GetLocation().Z
+				, Transforms[i].GetRotation().X, Transforms[i].GetRotation().Y, Transforms[i].GetRotation().Z, Transforms[i].GetRotation().W);
 			
 			///		APPLYING THE TRANSFORMS TO APPROPRIATE BONE USING BONE REFERENCES
 
 			// the way we apply transform is same as FMatrix or FTransform
 			// we apply scale first, and rotation, and translation
 			// if you'd like to translate first, you'll need two nodes that first node does translate and second nodes to rotate.
-			FQuat Rotation = FrameData->Transforms[i].GetRotation();
-			FVector Translation = FrameData->Transforms[i].GetTranslation();
-			FVector Scale = FrameData->Transforms[i].GetScale3D();
+			FQuat Rotation = Transforms[i].GetRotation();
+			FVector Translation = Transforms[i].GetTranslation();
+			FVector Scale = Transforms[i].GetScale3D();
 
-			const FBoneContainer& BoneContainer = Output.Pose.GetPose().GetBoneContainer();
-			FCompactPoseBoneIndex CompactPoseBoneToModify = BoneReferencesArray[boneReferenceIndex].GetCompactPoseIndex(BoneContainer);
 			FTransform NewBoneTM = Output.Pose.GetComponentSpaceTransform(CompactPoseBoneToModify);
 			FTransform ComponentTransform = Output.AnimInstanceProxy->GetComponentTransform();
 
@@ -94,19 +120,56 @@ void FRGBRokokoAnimNode::EvaluateSkeletalControl_AnyThread(FComponentSpacePoseCo
 			// Convert back to Component Space.
 			FAnimationRuntime::ConvertBoneSpaceTransformToCS(ComponentTransform, Output.Pose, NewBoneTM, CompactPoseBoneToModify, EBoneControlSpace::BCS_BoneSpace);
 
-			FCompactPoseBoneIndex compactBoneINdex= BoneReferencesArray[boneReferenceIndex].GetCompactPoseIndex(BoneContainer);
-			//OutBoneTransforms.Add(FBoneTransform(compactBoneINdex, NewBoneTM));
-			CopyOfOutBoneTransforms.Add(FBoneTransform(compactBoneINdex, NewBoneTM));
-			Output.Pose.LocalBlendCSBoneTransforms(CopyOfOutBoneTransforms, 1.0f);
-			CopyOfOutBoneTransforms.Reset();
+			OutBoneTransforms.Add(FBoneTransform(CompactPoseBoneToModify, NewBoneTM));
 		}
 	}
+
+	INC_DWORD_STAT_BY(STAT_RGBRokokoBonesApplied, OutBoneTransforms.Num());
+
+	///		THE BASE CLASS BLENDS EVERY BONE IN ONE PASS AND EXPECTS PARENTS BEFORE CHILDREN, WHICH COMPACT POSE ORDER GUARANTEES
+	OutBoneTransforms.Sort(FCompareBoneTransformIndex());
 }
 
 
 
 
 
+///		ONE CONVERSION OF THE WHOLE POSE TO LOCAL SPACE, A ROTATION AND SCALE MULTIPLY PER BONE, AND ONE LAZY CONVERSION BACK
+void FRGBRokokoAnimNode::EvaluateLocalSpace(FComponentSpacePoseContext& Output, const TArray<FTransform>& Transforms, int32 NumBones)
+{
+	FCompactPose LocalPose;
+	FCSPose<FCompactPose>::ConvertComponentPosesToLocalPoses(Output.Pose, LocalPose);
+
+	// Nothing goes through OutBoneTransforms here, so the node's alpha is applied directly
+	const float BlendWeight = FMath::Clamp<float>(ActualAlpha, 0.f, 1.f);
+	int32 NumBonesApplied = 0;
+	for (int32 i = 0; i < NumBones; i++)
+	{
+		const FCompactPoseBoneIndex CompactPoseBoneToModify = LiveLinkToCompactPose[i];
+		if (!CompactPoseBoneToModify.IsValid())
+		{
+			continue;
+		}
+		NumBonesApplied++;
+
+		FQuat Rotation = Transforms[i].GetRotation();
+		FVector Scale = Transforms[i].GetScale3D();
+		if (BlendWeight < 1.f)
+		{
+			Rotation = FQuat::Slerp(FQuat::Identity, Rotation, BlendWeight);
+			Scale = FMath::Lerp(FVector::OneVector, Scale, BlendWeight);
+		}
+
+		// Same as the component space path's (Rotation, 0, Scale) * Bone, taken relative to the parent instead
+		FTransform& LocalTransform = LocalPose[CompactPoseBoneToModify];
+		LocalTransform.SetRotation((LocalTransform.GetRotation() * Rotation).GetNormalized());
+		LocalTransform.SetScale3D(LocalTransform.GetScale3D() * Scale);
+	}
+
+	Output.Pose.InitPose(MoveTemp(LocalPose));
+	INC_DWORD_STAT_BY(STAT_RGBRokokoBonesApplied, NumBonesApplied);
+}
+
 void FRGBRokokoAnimNode::GatherDebugData(FNodeDebugData& DebugData)
 {
 	FString DebugLine = DebugData.GetNodeName(this);
@@ -134,7 +197,7 @@ void FRGBRokokoAnimNode::PreUpdate(const UAnimInstance* InAnimInstance)
 
 FLiveLinkSubjectName FRGBRokokoAnimNode::GetLiveLinkSubjectName()
 {
-	return FName(RGBMocapActorName.ToString());
+	return RGBMocapActorName;
 }
 
 FVector FRGBRokokoAnimNode::GetVectorFromCurvesCpp(const FString BoneName)
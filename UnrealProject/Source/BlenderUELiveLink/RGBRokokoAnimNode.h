@@ -241,6 +241,11 @@ struct BLENDERUELIVELINK_API FRGBRokokoAnimNode : public FAnimNode_SkeletalContr
 	UPROPERTY(EditAnywhere, Category = RGBSkeletalControl)
 		URGBRokokoBoneMap* BoneMapOverride;
 
+	// Applies the incoming rotations and scales in local (parent) space like a pose node, so children follow their parents,
+	// and converts the pose back to component space once instead of converting every bone
+	UPROPERTY(EditAnywhere, Category = RGBSkeletalControl)
+		bool bLocalSpaceFastPath;
+
 
 	//For bone rotations 
 
@@ -264,8 +269,14 @@ struct BLENDERUELIVELINK_API FRGBRokokoAnimNode : public FAnimNode_SkeletalContr
 	FTransform CalcTransformForRotation(const FString FirstBone, const FString SecondBone, const bool useXZ = false, const bool invertForward = false);
 
 	TArray<FBoneReference> BoneReferencesArray;
+
+	// Compact pose index of every LiveLink bone, INDEX_NONE for bones missing from the mesh, rebuilt when RemapBoneNames changes
+	TArray<FCompactPoseBoneIndex> LiveLinkToCompactPose;
+	TArray<FName> RemapBoneNames;
+	void BuildBoneRemap(const TArray<FName>& LiveLinkBoneNames, const FBoneContainer& BoneContainer);
+	void EvaluateLocalSpace(FComponentSpacePoseContext& Output, const TArray<FTransform>& Transforms, int32 NumBones);
+
 	bool firstTime;
-	TArray<FBoneTransform> CopyOfOutBoneTransforms;
 
 
 	//Bone References; 